@@ -15,6 +15,7 @@ struct Data
 {
   unsigned int avail;
   Loc pos;          // degrees
+  NVector nv;       // n-vector of pos
   double alt;       // feet
   double hdg;       // degrees (ground track)
   double gs;        // knots
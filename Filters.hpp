@@ -0,0 +1,553 @@
+#ifndef Filters_hpp
+#define Filters_hpp
+
+#include <cmath>
+#include "RingAverage.hpp"
+
+/**
+ * Allocation-free filters for FlightDirector inputs. Every filter has fixed
+ * storage, is default-constructible with its parameters given as template
+ * arguments in samples, and has the same interface as RingAverage:
+ *
+ *   Sample                   the sample type, T.
+ *   T pushSample(T _sample)  filters one sample and returns the output.
+ *   T value() const          the last output, 0 before the first sample.
+ *   void reset()             forgets all samples.
+ *
+ * TimeAverage weights samples by the time between them and so is pushed with
+ * the interval as well; pushTimed() pushes a sample and its interval into any
+ * filter, passing the interval on only to those that use it.
+ *
+ * Group delays are for slowly varying input, in samples; bench_filters
+ * measures them along with the cost per sample.
+ */
+
+/**
+ * Exponential moving average with the usual span parameterization: alpha is
+ * 2 / (Span + 1), so it has the same mean age as a Span-sample boxcar. Group
+ * delay is (Span - 1) / 2. The first sample initializes the output.
+ */
+template <typename T, unsigned int Span>
+class Ema
+{
+  static_assert(Span > 0, "Ema span must be at least one sample");
+
+public:
+  typedef T Sample;
+
+public:
+  Ema()
+  {
+    reset();
+  }
+
+public:
+  T pushSample(T _sample)
+  {
+    static const T alpha = static_cast<T>(2) / static_cast<T>(Span + 1);
+
+    y = (primed ? y + alpha * (_sample - y) : _sample);
+    primed = true;
+    return y;
+  }
+
+  T value() const
+  {
+    return y;
+  }
+
+  void reset()
+  {
+    y = static_cast<T>(0);
+    primed = false;
+  }
+
+private:
+  T y;
+  bool primed;
+};
+
+/**
+ * Second-order Butterworth low-pass biquad, direct form II transposed, with
+ * the cutoff at 1 / Period of the sample rate; Period must be at least 3
+ * samples. Group delay at low frequencies approaches Period * sqrt(2) / (2 pi),
+ * or 0.225 * Period, for long periods and is somewhat less for short ones.
+ * The state is initialized to the first sample, so there is no step from zero
+ * at start-up.
+ */
+template <typename T, unsigned int Period>
+class LowPass
+{
+  static_assert(Period >= 3, "LowPass cutoff must be below the Nyquist frequency");
+
+public:
+  typedef T Sample;
+
+public:
+  LowPass()
+  {
+    double w0 = 2.0 * M_PI / Period, c = cos(w0), alpha = sin(w0) / (2.0 * M_SQRT1_2), a0 = 1.0 + alpha;
+
+    // Bristow-Johnson's cookbook low-pass with Q = 1 / sqrt(2).
+    b0 = static_cast<T>((1.0 - c) / 2.0 / a0);
+    b1 = static_cast<T>((1.0 - c) / a0);
+    b2 = b0;
+    a1 = static_cast<T>(-2.0 * c / a0);
+    a2 = static_cast<T>((1.0 - alpha) / a0);
+
+    reset();
+  }
+
+public:
+  T pushSample(T _sample)
+  {
+    if (!primed)
+    {
+      z2 = (b2 - a2) * _sample;
+      z1 = (b1 - a1) * _sample + z2;
+      primed = true;
+    }
+
+    y = b0 * _sample + z1;
+    z1 = b1 * _sample - a1 * y + z2;
+    z2 = b2 * _sample - a2 * y;
+    return y;
+  }
+
+  T value() const
+  {
+    return y;
+  }
+
+  void reset()
+  {
+    y = z1 = z2 = static_cast<T>(0);
+    primed = false;
+  }
+
+private:
+  T b0, b1, b2, a1, a2;
+  T y, z1, z2;
+  bool primed;
+};
+
+/**
+ * Median of the last N samples, for rejecting isolated spikes such as GPS
+ * heading jumps; up to (N - 1) / 2 consecutive outliers are removed entirely.
+ * The window is kept sorted alongside the ring, so a push removes the oldest
+ * sample and inserts the new one: O(N), which is cheap for the small windows
+ * this is meant for. With an even N the output is the mean of the middle two.
+ * Group delay is (N - 1) / 2.
+ */
+template <typename T, unsigned int N>
+class SlidingMedian
+{
+  static_assert(N > 0, "SlidingMedian needs at least one sample");
+
+public:
+  typedef T Sample;
+
+public:
+  SlidingMedian()
+  {
+    reset();
+  }
+
+public:
+  T pushSample(T _sample)
+  {
+    unsigned int j;
+
+    if (samples == N)
+    {
+      for (j = find(ring[i]), --samples; j < samples; ++j)
+        sorted[j] = sorted[j + 1];
+    }
+
+    for (j = samples++; j > 0 && _sample < sorted[j - 1]; --j)
+      sorted[j] = sorted[j - 1];
+
+    sorted[j] = _sample;
+
+    ring[i] = _sample;
+    i = (i + 1 == N ? 0 : i + 1);
+
+    y = ((samples & 1) != 0 ? sorted[samples / 2]
+                            : (sorted[samples / 2 - 1] + sorted[samples / 2]) / static_cast<T>(2));
+    return y;
+  }
+
+  T value() const
+  {
+    return y;
+  }
+
+  void reset()
+  {
+    i = samples = 0;
+    y = static_cast<T>(0);
+  }
+
+private:
+  /**
+   * Index of the first sorted sample not less than _v.
+   */
+  unsigned int find(T _v) const
+  {
+    unsigned int lo = 0, hi = samples, mid;
+
+    while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+
+      if (sorted[mid] < _v)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    return lo;
+  }
+
+private:
+  T ring[N];
+  T sorted[N];
+  unsigned int i, samples;
+  T y;
+};
+
+/**
+ * Savitzky-Golay first derivative over the last N samples: the slope of the
+ * least-squares line (equivalently, quadratic) through the window, in units
+ * per sample. It estimates the derivative at the middle of the window, so the
+ * group delay is (N - 1) / 2, but it differentiates and smooths in one step
+ * rather than smoothing a noisy first difference. Until N samples have been
+ * pushed the fit is over the samples so far; a single sample has slope 0.
+ */
+template <typename T, unsigned int N>
+class SavitzkyGolay
+{
+  static_assert(N >= 2, "SavitzkyGolay needs at least two samples");
+
+public:
+  typedef T Sample;
+
+public:
+  SavitzkyGolay()
+  {
+    reset();
+  }
+
+public:
+  T pushSample(T _sample)
+  {
+    T mid, den = static_cast<T>(0), num = static_cast<T>(0), k;
+    unsigned int j, o;
+
+    ring[i] = _sample;
+    i = (i + 1 == N ? 0 : i + 1);
+    samples = (samples < N ? samples + 1 : N);
+
+    // o is the oldest sample; k runs from -(n - 1) / 2 to (n - 1) / 2.
+    o = (samples < N ? 0 : i);
+    mid = static_cast<T>(samples - 1) / static_cast<T>(2);
+
+    for (j = 0; j < samples; ++j)
+    {
+      k = static_cast<T>(j) - mid;
+      num += k * ring[o];
+      den += k * k;
+      o = (o + 1 == N ? 0 : o + 1);
+    }
+
+    y = (samples > 1 ? num / den : static_cast<T>(0));
+    return y;
+  }
+
+  T value() const
+  {
+    return y;
+  }
+
+  void reset()
+  {
+    i = samples = 0;
+    y = static_cast<T>(0);
+  }
+
+private:
+  T ring[N];
+  unsigned int i, samples;
+  T y;
+};
+
+/**
+ * Time-weighted average over the last Duration milliseconds, for samples that
+ * arrive at irregular intervals. Each sample is weighted by the interval it
+ * covers, i.e. the time since the previous sample, and the oldest sample in
+ * the window is weighted only by the part of its interval inside the window.
+ * Until Duration has passed the average is over the time so far.
+ *
+ * At most N samples are kept; if more than N arrive within Duration the
+ * window is cut short to the last N. Samples are evicted once each, so a push
+ * is O(1) amortized. The sums are split into tail and fresh parts and
+ * re-based whenever the last sample of the tail is evicted, as RingAverage
+ * does, so they do not drift.
+ */
+template <typename T, unsigned int Duration, unsigned int N = 256>
+class TimeAverage
+{
+  static_assert(Duration > 0, "TimeAverage needs a duration");
+  static_assert(N > 0, "TimeAverage needs at least one sample");
+
+public:
+  typedef T Sample;
+
+public:
+  TimeAverage()
+  {
+    reset();
+  }
+
+public:
+  T pushSample(T _sample, unsigned int _elapsedMilliseconds)
+  {
+    T dt = static_cast<T>(_elapsedMilliseconds), span, excess;
+    unsigned int o;
+
+    if (samples == N)
+      evict();
+
+    ring[head & mask] = _sample;
+    interval[head & mask] = dt;
+    freshSum += _sample * dt;
+    freshTime += dt;
+    ++head;
+    ++samples;
+
+    // Drop samples whose whole interval is before the window.
+    while (samples > 1 && tailTime + freshTime - interval[(head - samples) & mask] >= static_cast<T>(Duration))
+      evict();
+
+    o = (head - samples) & mask;
+    span = tailTime + freshTime;
+
+    if (span > static_cast<T>(Duration))
+    {
+      excess = span - static_cast<T>(Duration);
+      y = (tailSum + freshSum - ring[o] * excess) / static_cast<T>(Duration);
+    }
+    else if (span > static_cast<T>(0))
+      y = (tailSum + freshSum) / span;
+    else
+      y = _sample;
+
+    return y;
+  }
+
+  T value() const
+  {
+    return y;
+  }
+
+  void reset()
+  {
+    head = samples = inTail = 0;
+    tailSum = tailTime = freshSum = freshTime = y = static_cast<T>(0);
+  }
+
+private:
+  void rebase()
+  {
+    tailSum = freshSum;
+    tailTime = freshTime;
+    freshSum = freshTime = static_cast<T>(0);
+    inTail = samples;
+  }
+
+  void evict()
+  {
+    unsigned int o = (head - samples) & mask;
+
+    // The oldest sample is always in the tail once there is one.
+    if (inTail == 0)
+      rebase();
+
+    tailSum -= ring[o] * interval[o];
+    tailTime -= interval[o];
+    --samples;
+
+    if (--inTail == 0)
+      rebase();
+  }
+
+private:
+  static const unsigned int capacity = ringCapacity(N);
+  static const unsigned int mask = capacity - 1;
+
+private:
+  T ring[capacity];
+  T interval[capacity];
+  unsigned int head, samples, inTail;
+  T tailSum, tailTime, freshSum, freshTime;
+  T y;
+};
+
+/**
+ * Pushes a sample taken _elapsedMilliseconds after the previous one. Filters
+ * that weight samples by time, TimeAverage and chains containing one, get the
+ * interval; the rest ignore it.
+ */
+template <typename Filter>
+inline typename Filter::Sample pushTimed(Filter &_filter, typename Filter::Sample _sample, unsigned int _elapsedMilliseconds)
+{
+  return _filter.pushSample(_sample);
+}
+
+template <typename T, unsigned int Duration, unsigned int N>
+inline T pushTimed(TimeAverage<T, Duration, N> &_filter, T _sample, unsigned int _elapsedMilliseconds)
+{
+  return _filter.pushSample(_sample, _elapsedMilliseconds);
+}
+
+/**
+ * Runs every sample through First and then Second, e.g. a SlidingMedian to
+ * remove spikes ahead of an Ema. Group delays add.
+ */
+template <typename First, typename Second>
+class FilterChain
+{
+public:
+  typedef typename Second::Sample Sample;
+
+public:
+  Sample pushSample(Sample _sample)
+  {
+    return second.pushSample(first.pushSample(_sample));
+  }
+
+  Sample pushSample(Sample _sample, unsigned int _elapsedMilliseconds)
+  {
+    return pushTimed(second, pushTimed(first, _sample, _elapsedMilliseconds), _elapsedMilliseconds);
+  }
+
+  Sample value() const
+  {
+    return second.value();
+  }
+
+  void reset()
+  {
+    first.reset();
+    second.reset();
+  }
+
+private:
+  First first;
+  Second second;
+};
+
+template <typename First, typename Second>
+inline typename FilterChain<First, Second>::Sample pushTimed(FilterChain<First, Second> &_filter,
+                                                             typename FilterChain<First, Second>::Sample _sample,
+                                                             unsigned int _elapsedMilliseconds)
+{
+  return _filter.pushSample(_sample, _elapsedMilliseconds);
+}
+
+/**
+ * Rate of change of a signal sampled at irregular intervals, in units per
+ * PerMilliseconds: 1000 for a rate per second, 60000 per minute. Each push
+ * differences the sample against the last one, divides by the interval, and
+ * runs the rate through Filter. The first push only records the sample.
+ */
+template <typename Filter, unsigned int PerMilliseconds = 1000>
+class RateFilter
+{
+public:
+  RateFilter()
+  {
+    reset();
+  }
+
+public:
+  double pushSample(double _sample, unsigned int _elapsedMilliseconds)
+  {
+    double last = prev;
+
+    prev = _sample;
+
+    if (!primed || _elapsedMilliseconds == 0)
+    {
+      primed = true;
+      return filter.value();
+    }
+
+    return pushTimed(filter, (_sample - last) * PerMilliseconds / _elapsedMilliseconds, _elapsedMilliseconds);
+  }
+
+  double value() const
+  {
+    return filter.value();
+  }
+
+  void reset()
+  {
+    filter.reset();
+    prev = 0.0;
+    primed = false;
+  }
+
+private:
+  Filter filter;
+  double prev;
+  bool primed;
+};
+
+/**
+ * With a SavitzkyGolay filter the signal itself goes through the fit and the
+ * slope per sample is divided by the mean interval over the same window.
+ */
+template <typename T, unsigned int N, unsigned int PerMilliseconds>
+class RateFilter<SavitzkyGolay<T, N>, PerMilliseconds>
+{
+public:
+  RateFilter()
+  {
+    reset();
+  }
+
+public:
+  double pushSample(double _sample, unsigned int _elapsedMilliseconds)
+  {
+    T slope = filter.pushSample(static_cast<T>(_sample));
+    T dt = interval.pushSample(static_cast<T>(_elapsedMilliseconds));
+
+    /**
+     * The slope over k samples spans k - 1 intervals; the interval pushed with
+     * the first sample is not one of them, but the mean is close enough once
+     * the window is full.
+     */
+    rate = (dt > static_cast<T>(0) ? slope * PerMilliseconds / dt : static_cast<T>(0));
+    return rate;
+  }
+
+  double value() const
+  {
+    return rate;
+  }
+
+  void reset()
+  {
+    filter.reset();
+    interval.reset();
+    rate = 0.0;
+  }
+
+private:
+  SavitzkyGolay<T, N> filter;
+  RingAverage<T, N> interval;
+  double rate;
+};
+
+#endif
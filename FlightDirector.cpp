@@ -6,16 +6,25 @@
 #include "FlightDirector.hpp"
 #include "GISDatabase.hpp"
 #include "Utilities.hpp"
+#include "ResponseCurves.hpp"
 
 using namespace std;
 
-static const unsigned int rateOfTurnDelay = 2;
-static const unsigned int verticalSpeedDelay = 5;
-static const unsigned int groundSpeedDelay = 5;
-
 static const double maxHdgErr = 30.0;
 static const double maxRoT = 3.0;
 static const double minAltAGL = 5000.0;
+static const double seekSectorHalfAngle = 45.0;   // as GISDatabase's sector
+
+/**
+ * Geodesy error budgets in NM; see geoModelFor(). Anything that feeds the
+ * target heading uses steeringError: the intercept correction is 45 degrees
+ * per NM-minute, so 0.01 NM is under half a degree at 60 kts. Track keeps to
+ * it out to the flat model's reach, about 37 NM; on longer legs it steers on
+ * the sphere, within about 0.02 NM. Glide range checks use rangeError, well
+ * inside the uncertainty of the glide distance itself.
+ */
+static const double steeringError = 0.01;
+static const double rangeError = 0.1;
 
 static inline double interceptCorrection(double _hdg, double _err, double _gs)
 {
@@ -34,19 +43,24 @@ static inline double maxCircleDistance(double _projDistance)
   return max(min(_projDistance / 2.0 - 1.0, 5.0), 1.0);
 }
 
-FlightDirector::FlightDirector(Autopilot *_ap, DataSource *_data, GISDatabase *_db, LogCallback _log)
+FlightDirector::FlightDirector(Autopilot *_ap, DataSource *_data, GISDatabase *_db, LogCallback _log,
+                               Terrain *_terrain,
+                               ReachGrid *_reach)
 : ap(_ap),
   data(_data),
   db(_db),
+  worker(nullptr),
+  terrain(_terrain),
+  reach(_reach),
   log(_log),
   mode(seekMode),
   projDistance(0),
+  projElev(0),
   targetHdg(0),
-  rateOfTurn(rateOfTurnDelay),
-  verticalSpeed(verticalSpeedDelay),
-  groundSpeed(groundSpeedDelay),
-  recoveryCourse(0),
-  seekCourseTime(0)
+  candidateCount(0),
+  seekCourseTime(0),
+  rudderHdg(0),
+  unwrappedHdg(0)
 {
   if (ap == nullptr)
     throw std::invalid_argument("_ap");
@@ -57,16 +71,31 @@ FlightDirector::FlightDirector(Autopilot *_ap, DataSource *_data, GISDatabase *_
   if (log == nullptr)
     throw std::invalid_argument("_log");
 
+  memset(&lastSample, 0, sizeof(lastSample));
   memset(&projLoc, 0, sizeof(projLoc));
   memset(&recoveryLoc, 0, sizeof(recoveryLoc));
-  memset(&originLoc, 0, sizeof(originLoc));
+  toNVector(recoveryLoc.pos, recoveryLoc.nv);
+
+  /**
+   * Database queries run on the worker thread so that refresh() never blocks
+   * on the database. If the thread cannot be started, the worker answers
+   * synchronously. Alternates are ranked by required glide ratio so that the
+   * first one in reach is the one with the most margin.
+   */
+  worker = new RecoveryWorker(db, recoveryGlideRatioCost);
+
+  if (!worker->start())
+    (*log)("OTTO: failed to start recovery query worker, querying synchronously.\n");
 }
 
 FlightDirector::~FlightDirector()
 {
+  delete worker; // Stop the worker before deleting the database.
   delete ap;
   delete data;
   delete db;
+  delete terrain;
+  delete reach;
 }
 
 void FlightDirector::enable()
@@ -80,6 +109,34 @@ void FlightDirector::disable()
 }
 
 void FlightDirector::refresh(unsigned int _elapsedMilliseconds)
+{
+  refreshNavigation(_elapsedMilliseconds);
+  refreshRudder(_elapsedMilliseconds);
+}
+
+void FlightDirector::refreshNavigation(unsigned int _elapsedMilliseconds)
+{
+  Data d;
+  Guidance g;
+
+  if (!data->sample(&d))
+    return;
+  if (_elapsedMilliseconds < 1)
+    return; // Divide by zero protection.
+
+  verticalSpeed.pushSample(d.alt, _elapsedMilliseconds);
+  pushTimed(groundSpeed, d.gs, _elapsedMilliseconds);
+  lastSample = d;
+
+  updateProjectedDistance(_elapsedMilliseconds);
+  updateHeading(_elapsedMilliseconds);
+
+  g.targetHdg = targetHdg;
+  g.valid = true;
+  guidance.publish(g);
+}
+
+void FlightDirector::refreshRudder(unsigned int _elapsedMilliseconds)
 {
   /**
    * Ra = Actual rate-of-turn derived from an averaged rate of GPS heading
@@ -90,6 +147,7 @@ void FlightDirector::refresh(unsigned int _elapsedMilliseconds)
    * Ar = Rudder angle calculated from the response curve below.
    */
   Data d;
+  Guidance g;
   double Ra, Rt, dR, dH, Ar;
 
   if (!data->sample(&d))
@@ -97,13 +155,19 @@ void FlightDirector::refresh(unsigned int _elapsedMilliseconds)
   if (_elapsedMilliseconds < 1)
     return; // Divide by zero protection.
 
-  Ra = rateOfTurn.pushSample((d.hdg - lastSample.hdg) * 1000 / _elapsedMilliseconds);
-  verticalSpeed.pushSample((d.alt - lastSample.alt) * 1000 / _elapsedMilliseconds * 60);
-  groundSpeed.pushSample(d.gs);
-  lastSample = d;
+  /**
+   * Track the heading without the wrap at 360 so that crossing north does not
+   * look like a 359 degree turn to the rate-of-turn filter.
+   */
+  unwrappedHdg += wrap180(d.hdg - rudderHdg);
+  rudderHdg = d.hdg;
 
-  updateProjectedDistance(_elapsedMilliseconds);
-  updateHeading(_elapsedMilliseconds);
+  Ra = rateOfTurn.pushSample(unwrappedHdg, _elapsedMilliseconds);
+
+  guidance.read(g);
+
+  if (!g.valid)
+    return;
 
   /**
    * The target rate-of-turn follows an exponential curve designed to hit +/- 3
@@ -114,9 +178,12 @@ void FlightDirector::refresh(unsigned int _elapsedMilliseconds)
    *
    *                    |dH|
    * Rt = ( 1.0472941228     - 1 ) * sgn( dH )
+   *
+   * Both response curves are evaluated as ResponseCurves.hpp selects, from
+   * tables by default.
    */
-  dH = fmod(fmod(targetHdg - d.hdg, 360.0) + 540.0, 360.0) - 180.0;
-  Rt = min(pow(1.0472941228, min(fabs(dH), maxHdgErr)) - 1, maxRoT) * sgn(dH);
+  dH = wrap180(g.targetHdg - d.hdg);
+  Rt = min(rateOfTurnCurve(min(fabs(dH), maxHdgErr)), maxRoT) * sgn(dH);
 
   if (d.avail & DATA_ROLL)
   // Reduce the target rate-of-turn if we have excessive bank.
@@ -132,7 +199,7 @@ void FlightDirector::refresh(unsigned int _elapsedMilliseconds)
    * Ar = ( log10( |dR| + .33 ) + .48 ) * sgn( dR )
    */
   dR = Rt - Ra;
-  Ar = min(log10(min(fabs(dR), maxRoT) + 0.33) + 0.48, 1.0) * sgn(dR);
+  Ar = min(rudderCurve(min(fabs(dR), maxRoT)), 1.0) * sgn(dR);
 
   if (d.avail & DATA_PITCH)
   {
@@ -145,6 +212,24 @@ void FlightDirector::refresh(unsigned int _elapsedMilliseconds)
 }
 
 void FlightDirector::updateProjectedDistance(unsigned int _elapsedMilliseconds)
+{
+  double elev = 0.0;
+
+  /**
+   * Glide to the recovery location's elevation once there is one. Until then,
+   * use the terrain under the aircraft if there is terrain data for it, or
+   * sea level if there is not.
+   */
+  if (recoveryLoc.id != -1)
+    elev = recoveryLoc.elev;
+  else if (terrain != nullptr && !terrain->getElevation(lastSample.pos, elev))
+    elev = 0.0;
+
+  projElev = elev;
+  projDistance = glideDistance(elev);
+}
+
+double FlightDirector::glideDistance(double _elev) const
 {
   /**
    * Assume a nominal -1 ft/s if the average vertical speed is greater than
@@ -156,14 +241,48 @@ void FlightDirector::updateProjectedDistance(unsigned int _elapsedMilliseconds)
    *
    * Clamp distance to 3,000 nm. This keeps the projections from getting silly.
    */
-  double av = min(verticalSpeed.average(), -1.0);
-  double ag = max(groundSpeed.average(), 0.0);
-  double agl = lastSample.alt;
+  double av = min(verticalSpeed.value(), -1.0);
+  double ag = max(groundSpeed.value(), 0.0);
+  double agl = lastSample.alt - _elev;
 
-  if (recoveryLoc.id != -1)
-    agl -= recoveryLoc.elev;
+  return min(agl / (-av * 60) * ag, 3000.0);
+}
+
+bool FlightDirector::switchToAlternate()
+{
+  double dis, brg;
+  size_t i;
+
+  /**
+   * The alternates are ranked as of the query that found the current target.
+   * Take the best one that is still within glide distance of the present
+   * position given its own elevation.
+   */
+  for (i = 0; i < candidateCount; ++i)
+  {
+    const RecoveryCandidate &c = candidates[i];
+
+    if (c.loc.id == recoveryLoc.id)
+      continue;
+
+    getDistanceAndBearing(lastSample.pos, lastSample.nv, c.loc.pos, c.loc.nv, dis, brg, rangeError);
+
+    if (dis > glideDistance(c.loc.elev))
+      continue;
+
+    (*log)("OTTO: no longer able to make %s, tracking to %s (elev. %.1f) on a course of %.0f.\n",
+      recoveryLoc.ident,
+      c.loc.ident,
+      c.loc.elev,
+      brg);
+
+    recoveryLoc = c.loc;
+    track.set(lastSample.pos, lastSample.nv, recoveryLoc.pos, recoveryLoc.nv);
 
-  projDistance = min(agl / (-av * 60) * ag, 3000.0);
+    return true;
+  }
+
+  return false;
 }
 
 void FlightDirector::updateProjectedLandingPoint(unsigned int _elapsedMilliseconds)
@@ -172,14 +291,14 @@ void FlightDirector::updateProjectedLandingPoint(unsigned int _elapsedMillisecon
    * The heading should be a true ground track so that we are taking winds into
    * account.
    */
-  getDestination(lastSample.pos, lastSample.hdg, projDistance, projLoc);
+  getDestination(lastSample.pos, lastSample.hdg, projDistance, projLoc, rangeError);
 }
 
 void FlightDirector::updateHeading(unsigned int _elapsedMilliseconds)
 {
   double dis = 0, brg = 0;
 
-  getDistanceAndBearing(lastSample.pos, recoveryLoc.pos, dis, brg);
+  getDistanceAndBearing(lastSample.pos, lastSample.nv, recoveryLoc.pos, recoveryLoc.nv, dis, brg, steeringError);
 
   switch (mode)
   {
@@ -197,24 +316,65 @@ void FlightDirector::updateHeading(unsigned int _elapsedMilliseconds)
 
 void FlightDirector::updateHeadingSeekMode(unsigned int _elapsedMilliseconds)
 {
+  RecoveryResult res;
   RecoveryLocation loc;
   double dis, brg;
 
-  if (db->getRecoveryLocation(lastSample.pos, lastSample.hdg, projDistance, loc))
+  /**
+   * If the reachability grid says a location is in reach from here at the
+   * reference glide ratio, take it without querying the database. The grid
+   * knows nothing of the actual glide, so only take the location if it is also
+   * within the projected glide distance to its elevation; track mode would
+   * drop it on the next refresh otherwise. That distance is projected along
+   * the present ground track with the present wind, so, like every database
+   * query, only take a location within 45 degrees of the ground track; one
+   * behind the aircraft would mean turning into the wind. Otherwise ask the
+   * worker.
+   */
+  if (reach != nullptr && reach->getReachableLocation(lastSample.pos, lastSample.alt, loc))
+  {
+    getDistanceAndBearing(lastSample.pos, lastSample.nv, loc.pos, loc.nv, dis, brg, steeringError);
+
+    if (dis <= glideDistance(loc.elev) && fabs(wrap180(brg - lastSample.hdg)) <= seekSectorHalfAngle)
+    {
+      mode = trackMode;
+      recoveryLoc = loc;
+      track.set(lastSample.pos, lastSample.nv, recoveryLoc.pos, recoveryLoc.nv);
+      candidateCount = 0;
+      worker->reset();
+      (*log)("OTTO: tracking to %s (elev. %.1f) on a course of %.0f from the reachability grid.\n",
+        loc.ident,
+        loc.elev,
+        brg);
+
+      return;
+    }
+  }
+
+  /**
+   * Pick up the answer to the previous request, if it has arrived. The answer
+   * is at least one refresh old, so compute the course from the present
+   * position rather than the position in the request.
+   */
+  if (worker->poll(res) && res.found)
   {
-    getDistanceAndBearing(lastSample.pos, loc.pos, dis, brg);
+    getDistanceAndBearing(lastSample.pos, lastSample.nv, res.loc.pos, res.loc.nv, dis, brg, steeringError);
 
     mode = trackMode;
-    recoveryLoc = loc;
-    originLoc = lastSample.pos;
-    recoveryCourse = brg;
+    recoveryLoc = res.loc;
+    track.set(lastSample.pos, lastSample.nv, recoveryLoc.pos, recoveryLoc.nv);
+    candidateCount = res.candidateCount;
+    memcpy(candidates, res.candidates, sizeof(RecoveryCandidate) * candidateCount);
+    worker->reset();
     (*log)("OTTO: tracking to %s (elev. %.1f) on a course of %.0f.\n",
-      loc.ident,
-      loc.elev,
+      res.loc.ident,
+      res.loc.elev,
       brg);
   }
   else
   {
+    worker->submit(lastSample.pos, lastSample.alt, lastSample.hdg, projDistance, projElev);
+
     // Fly a box pattern with 1 minute legs.
     seekCourseTime += _elapsedMilliseconds;
 
@@ -228,20 +388,28 @@ void FlightDirector::updateHeadingSeekMode(unsigned int _elapsedMilliseconds)
 
 void FlightDirector::updateHeadingTrackMode(unsigned int _elapsedMilliseconds, double _dis, double _brg)
 {
-  double x, ag = groundSpeed.average(), md = maxCircleDistance(projDistance);
+  double x, ag = groundSpeed.value(), md = maxCircleDistance(projDistance);
 
   if (_dis > projDistance && lastSample.alt - recoveryLoc.elev > minAltAGL)
   {
     /**
      * If the distance to the current recovery point is greater than our
-     * projected glide distance, go back into seek mode.  UNLESS we are below
-     * 5000 feet AGL. In that case, just keep heading toward the recovery
-     * location.
+     * projected glide distance, switch to the best alternate still in reach,
+     * or go back into seek mode if there is none.  UNLESS we are below 5000
+     * feet AGL. In that case, just keep heading toward the recovery location.
      */
+    if (switchToAlternate())
+      return;
+
     mode = seekMode;
     recoveryLoc.id = -1;
+    candidateCount = 0;
     seekCourseTime = 0;
     (*log)("OTTO: no longer able to make %s, entering seek mode.\n", recoveryLoc.ident);
+
+    // Do not circle or steer toward the location just given up on; seek mode
+    // takes over on the next refresh.
+    return;
   }
 
   if (_dis <= md + 2.0)
@@ -264,18 +432,18 @@ void FlightDirector::updateHeadingTrackMode(unsigned int _elapsedMilliseconds, d
    * Cross-track error is negative when left of course and positive when right
    * of course, so subtract the intercept correction.
    */
-  x = crossTrackError(originLoc, recoveryLoc.pos, lastSample.pos);
-  targetHdg = interceptCorrection(recoveryCourse, x, ag);
+  x = track.crossTrackError(lastSample.pos, lastSample.nv, steeringError);
+  targetHdg = interceptCorrection(track.course(lastSample.pos, lastSample.nv, steeringError), x, ag);
 }
 
 void FlightDirector::updateHeadingCircleMode(unsigned int _elapsedMilliseconds, double _dis, double _brg)
 {
-  double ag = groundSpeed.average(), md = maxCircleDistance(projDistance);
+  double ag = groundSpeed.value(), md = maxCircleDistance(projDistance);
 
   if (_dis > md + 5.0)
   {
     mode = trackMode;
-    recoveryCourse = _brg;
+    track.set(lastSample.pos, lastSample.nv, recoveryLoc.pos, recoveryLoc.nv);
     (*log)("OTTO: entering track mode to %s on a new course of %.0f.\n",
       recoveryLoc.ident,
       _brg);
@@ -4,13 +4,34 @@
 #include "Autopilot.hpp"
 #include "DataSource.hpp"
 #include "GISDatabase.hpp"
-#include "AveragingBuffer.hpp"
+#include "RecoveryWorker.hpp"
+#include "Terrain.hpp"
+#include "ReachGrid.hpp"
+#include "Track.hpp"
+#include "Filters.hpp"
+#include "Handoff.hpp"
 
 typedef void (*LogCallback)(const char *_fmt, ...);
 
 class FlightDirector
 {
 private:
+  /**
+   * Input filters, chosen per channel here. Any filter in Filters.hpp or a
+   * RingAverage will do. The rate channels are fed the signal itself: a
+   * RateFilter differences it and filters the rate, or with a SavitzkyGolay
+   * filter differentiates it directly. For example, to reject heading spikes
+   * before smoothing the rate of turn:
+   *
+   *   typedef RateFilter<FilterChain<SlidingMedian<double, 3>, Ema<double, 2> > > RateOfTurnFilter;
+   *
+   * The defaults average over a fixed time rather than a fixed number of
+   * samples, so irregular refresh intervals are weighted correctly.
+   */
+  typedef RateFilter<TimeAverage<double, 2000>, 1000> RateOfTurnFilter;      // deg/s
+  typedef RateFilter<TimeAverage<double, 5000>, 60000> VerticalSpeedFilter;  // ft/min
+  typedef TimeAverage<double, 5000> GroundSpeedFilter;                       // kts
+
   enum Mode
   {
     seekMode,
@@ -18,8 +39,19 @@ private:
     circleMode
   };
 
+  /**
+   * What the navigation loop hands the rudder loop.
+   */
+  struct Guidance
+  {
+    double targetHdg;
+    bool valid;
+  };
+
 public:
-  FlightDirector(Autopilot *_ap, DataSource *_data, GISDatabase *_db, LogCallback _log);
+  FlightDirector(Autopilot *_ap, DataSource *_data, GISDatabase *_db, LogCallback _log,
+                 Terrain *_terrain = nullptr,
+                 ReachGrid *_reach = nullptr);
 
 public:
   ~FlightDirector();
@@ -29,11 +61,34 @@ public:
 
   void disable();
 
+  /**
+   * FlightDirector runs as two loops. The navigation loop picks the recovery
+   * location and the target heading: seek, track, and circle modes, the glide
+   * projection, and database lookups. It is meant to run about once a second.
+   * The rudder loop only tracks the target heading through the rate of turn
+   * and sets the rudder, so it is cheap enough to run at 20-50 Hz.
+   *
+   * Each loop keeps its own state and timing. The target heading is handed
+   * from the navigation loop to the rudder loop through a Handoff, so the two
+   * may run on different threads, one thread each, without locks. Until the
+   * navigation loop has run once the rudder loop leaves the rudder alone.
+   */
+  void refreshNavigation(unsigned int _elapsedMilliseconds);
+
+  void refreshRudder(unsigned int _elapsedMilliseconds);
+
+  /**
+   * Runs both loops in turn, for hosts with a single loop.
+   */
   void refresh(unsigned int _elapsedMilliseconds);
 
 private:
   void updateProjectedDistance(unsigned int _elapsedMilliseconds);
 
+  double glideDistance(double _elev) const;
+
+  bool switchToAlternate();
+
   void updateProjectedLandingPoint(unsigned int _elapsedMilliseconds);
 
   void updateHeading(unsigned int _elapsedMilliseconds);
@@ -48,18 +103,27 @@ private:
   Autopilot *ap;
   DataSource *data;
   GISDatabase *db;
+  RecoveryWorker *worker;
+  Terrain *terrain;
+  ReachGrid *reach;
   LogCallback log;
   Mode mode;
   Data lastSample;
   Loc projLoc;
-  double projDistance, targetHdg;
-  AveragingBuffer rateOfTurn;
-  AveragingBuffer verticalSpeed;
-  AveragingBuffer groundSpeed;
-  Loc originLoc;
+  double projDistance, projElev, targetHdg;
+  VerticalSpeedFilter verticalSpeed;
+  GroundSpeedFilter groundSpeed;
   RecoveryLocation recoveryLoc;
-  double recoveryCourse;
+  size_t candidateCount;
+  RecoveryCandidate candidates[MAX_RECOVERY_CANDIDATES];
+  Track track;
   unsigned int seekCourseTime;
+  Handoff<Guidance> guidance;
+
+  // Rudder loop state.
+  double rudderHdg;
+  double unwrappedHdg;
+  RateOfTurnFilter rateOfTurn;
 };
 
 #endif
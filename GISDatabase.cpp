@@ -1,31 +1,257 @@
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+#include <unistd.h>
 #include <cstdlib>
 #include <cstring>
+#include <cfloat>
+#include <algorithm>
 #include <sqlite3.h>
+#ifndef NO_SPATIALITE
 #include <spatialite.h>
+#endif
 #include "GISDatabase.hpp"
+#include "RecoveryFile.hpp"
+#include "RecoveryIndex.hpp"
+#include "RecoveryTable.hpp"
+#include "Terrain.hpp"
+
+using namespace std;
 
 static const double nm2m = 1852.0;
+static const double nm2ft = 6076.12;
+
+/**
+ * Track tolerances to try, in order, when building a RecoveryRegion, and the
+ * largest position radius to certify.
+ */
+static const double regionHdgTolerances[] = { 10.0, 5.0, 2.0 };
+static const double maxRegionRadius = 5.0;
+static const double sectorHalfAngle = 45.0;
+
+/**
+ * The least height, in feet, by which the glide to a recovery location must
+ * clear the terrain along the way.
+ */
+static const double minTerrainClearance = 0.0;
+
+/**
+ * The lowest elevation of any recovery location, in feet, if the dataset
+ * cannot say: the shore of the Dead Sea, the lowest dry land.
+ */
+static const double lowestLandElev = -1420.0;
 
-GISDatabase::GISDatabase(const char *_dbPath)
-: dbhandle(nullptr),
-  cache(nullptr)
+/**
+ * How often the watcher checks for changes, and how long the database file
+ * must be left alone before it is reloaded, in microseconds.
+ */
+static const useconds_t watchInterval = 250000;
+static const useconds_t reloadDelay = 1000000;
+
+/**
+ * One loaded copy of the recovery database. Exactly one of the backends is
+ * in use; see openDataset().
+ */
+struct RecoveryDataset
 {
-  openDatabase(_dbPath);
+  void *dbhandle;
+  void *cache;
+  RecoveryIndex *index;
+  RecoveryFile *file;
+  RecoveryTable *table;
+  double minElev;         // lowest location elevation; see lowestElevation()
+};
+
+/**
+ * Nothing is farther than this; FlightDirector clamps its glide projection to
+ * the same distance.
+ */
+static const double maxReachDistance = 3000.0;
+
+/**
+ * The distance and bearing to one location from the present position, and
+ * how far the bearing is off the ground track, all in the scan's order.
+ */
+struct RegionCandidate
+{
+  int64_t id;
+  double dis;
+  double brg;
+  double off;
+};
+
+static double bearingChangeBound(const Loc &_ppos, double _dis, double _radius)
+{
+  /**
+   * Bound the change in the bearing to a location at distance _dis when the
+   * observer moves up to _radius. The first term is the angle the location
+   * subtends; the second is meridian convergence (north itself turns as the
+   * observer changes longitude).
+   */
+  double r = _radius / earthRadius, d = _dis / earthRadius, lat, x;
+
+  if (_dis <= _radius)
+    return 180.0;
+
+  lat = degToRad(fabs(_ppos.lat)) + r;
+
+  if (lat >= degToRad(89.0))
+    return 180.0;
+
+  x = asin(min(sin(r) / sin(min(d, M_PI_2)), 1.0));
+  x += asin(min(sin(r) / cos(lat), 1.0)) * sin(lat);
+
+  return radToDeg(x);
 }
 
-GISDatabase::~GISDatabase()
+static double reachDistance(double _alt, double _maxDistance, double _elev, double _siteElev)
 {
-  closeDatabase();
+  /**
+   * _maxDistance is the glide down to _elev. The glide ratio is the same down
+   * to any other elevation, so rescale it by height.
+   */
+  double agl = _alt - _elev;
+
+  if (_alt <= _siteElev)
+    return -1.0;
+  if (agl <= 0.0)
+    return _maxDistance;
+
+  return min(_maxDistance * (_alt - _siteElev) / agl, maxReachDistance);
 }
 
-bool GISDatabase::openDatabase(const char *_dbPath)
+static void measureLocations(const Loc &_ppos, double _hdg, const vector<RecoveryLocation> &_locs, vector<RegionCandidate> &_measured)
 {
+  size_t i, n = _locs.size();
+  vector<double> lat(n), lon(n), dis(n), brg(n);
+
+  /**
+   * A region query can return thousands of locations, so measure them with
+   * the batch kernel rather than one at a time.
+   */
+  for (i = 0; i < n; ++i)
+  {
+    lat[i] = _locs[i].pos.lat;
+    lon[i] = _locs[i].pos.lon;
+  }
+
+  getDistancesAndBearings(_ppos, lat.data(), lon.data(), n, dis.data(), brg.data());
+
+  _measured.resize(n);
+
+  for (i = 0; i < n; ++i)
+  {
+    _measured[i].id = _locs[i].id;
+    _measured[i].dis = dis[i];
+    _measured[i].brg = brg[i];
+    _measured[i].off = fabs(fmod(fmod(brg[i] - _hdg, 360.0) + 540.0, 360.0) - 180.0);
+  }
+}
+
+static bool regionIsValid(const Loc &_ppos,
+                          double _maxDistance,
+                          const vector<RegionCandidate> &_cands,
+                          const RegionCandidate *_best,
+                          double _radius,
+                          double _hdgTol)
+{
+  double lo = _maxDistance - _radius, hi = _maxDistance + _radius, e;
+  size_t i;
+
+  /**
+   * The answer cannot change if the chosen location stays within range and
+   * within the sector, and every other location either stays out of range or
+   * out of the sector, or stays farther away than the chosen location.
+   */
+  if (_best != nullptr)
+  {
+    e = bearingChangeBound(_ppos, _best->dis, _radius);
+
+    if (_best->dis + _radius > lo || _best->off + _hdgTol + e > sectorHalfAngle)
+      return false;
+  }
+
+  for (i = 0; i < _cands.size(); ++i)
+  {
+    if (&_cands[i] == _best)
+      continue;
+
+    if (_cands[i].dis - _radius > hi)
+      continue;
+
+    if (_best != nullptr && _cands[i].dis - _radius > _best->dis + _radius)
+      continue;
+
+    e = bearingChangeBound(_ppos, _cands[i].dis, _radius);
+
+    if (_cands[i].off - _hdgTol - e > sectorHalfAngle)
+      continue;
+
+    return false;
+  }
+
+  return true;
+}
+
+#ifndef NO_SPATIALITE
+static void readRecoveryLocation(sqlite3_stmt *_stmt, RecoveryLocation &_loc)
+{
+  const unsigned char *blob;
+  int size;
+  gaiaGeomCollPtr g;
+
+  size = sqlite3_column_bytes(_stmt, 3);
+  blob = (const unsigned char*)sqlite3_column_blob(_stmt, 3);
+  g = gaiaFromSpatiaLiteBlobWkb(blob, size);
+  _loc.pos.lat = g->FirstPoint->Y;
+  _loc.pos.lon = g->FirstPoint->X;
+  toNVector(_loc.pos, _loc.nv);
+  gaiaFreeGeomColl(g);
+
+  _loc.elev = sqlite3_column_double(_stmt, 2);
+  strncpy(_loc.ident, (const char*)sqlite3_column_text(_stmt, 1), 8);
+  _loc.ident[8] = 0;
+  _loc.id = sqlite3_column_int64(_stmt, 0);
+}
+#endif
+
+double recoveryDistanceCost(const RecoveryCandidate &_cand, void *_arg)
+{
+  return _cand.distance;
+}
+
+double recoveryGlideRatioCost(const RecoveryCandidate &_cand, void *_arg)
+{
+  return _cand.glideRatio;
+}
+
+bool RecoveryRegion::contains(const Loc &_ppos, double _hdg, double _maxDistance) const
+{
+  double dis, brg, dH;
+
+  if (radius < 0.0 || _maxDistance < minDistance || _maxDistance > maxDistance)
+    return false;
+
+  dH = fabs(fmod(fmod(_hdg - hdg, 360.0) + 540.0, 360.0) - 180.0);
+
+  if (dH > hdgTolerance)
+    return false;
+
+  getDistanceAndBearing(pos, _ppos, dis, brg);
+
+  return (dis <= radius);
+}
+
+static bool openSpatiaLite(RecoveryDataset *_ds, const char *_dbPath)
+{
+#ifdef NO_SPATIALITE
+  return false;
+#else
   int ret;
   sqlite3 *db;
 
-  if (isOpen())
-    closeDatabase();
-
   ret = sqlite3_open_v2(
    _dbPath,
    &db,
@@ -40,45 +266,251 @@ bool GISDatabase::openDatabase(const char *_dbPath)
     return false;
   }
 
-  cache = spatialite_alloc_connection();
-  spatialite_init_ex(db, cache, 0);
-  dbhandle = db;
+  _ds->cache = spatialite_alloc_connection();
+  spatialite_init_ex(db, _ds->cache, 0);
+  _ds->dbhandle = db;
 
   return true;
+#endif
 }
 
-void GISDatabase::closeDatabase()
+static void closeSpatiaLite(RecoveryDataset *_ds)
 {
-  if (!isOpen())
+  if (_ds->dbhandle == nullptr)
     return;
 
-  sqlite3_close((sqlite3*)dbhandle);
-  spatialite_cleanup_ex(cache);
-  spatialite_shutdown();
+  sqlite3_close((sqlite3*)_ds->dbhandle);
+#ifndef NO_SPATIALITE
+  // Only the connection's cache; ~GISDatabase() shuts SpatiaLite down.
+  spatialite_cleanup_ex(_ds->cache);
+#endif
 
-  dbhandle = nullptr;
-  cache = nullptr;
+  _ds->dbhandle = nullptr;
+  _ds->cache = nullptr;
 }
 
-bool GISDatabase::isOpen() const
+static bool loadIndex(RecoveryDataset *_ds)
 {
-  return (dbhandle != nullptr);
+#ifndef NO_SPATIALITE
+  sqlite3 *db = (sqlite3*)_ds->dbhandle;
+  RecoveryLocation loc;
+  sqlite3_stmt *stmt;
+  int ret;
+#endif
+  vector<RecoveryLocation> locs;
+  RecoveryIndex *idx;
+  size_t i;
+
+  if (_ds->table != nullptr)
+  {
+    if (!_ds->table->getAllLocations(locs))
+      return false;
+
+    idx = new RecoveryIndex();
+
+    for (i = 0; i < locs.size(); ++i)
+      idx->addLocation(locs[i]);
+
+    idx->build();
+    delete _ds->index;
+    _ds->index = idx;
+
+    return true;
+  }
+
+#ifdef NO_SPATIALITE
+  return false;
+#else
+  if (db == nullptr)
+    return false;
+
+  ret = sqlite3_prepare_v2(
+   db,
+   "SELECT pkid, ident, elev, location FROM recovery",
+   -1,
+   &stmt,
+   nullptr);
+
+  if (ret != SQLITE_OK)
+    return false;
+
+  idx = new RecoveryIndex();
+
+  while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+  {
+    readRecoveryLocation(stmt, loc);
+    idx->addLocation(loc);
+  }
+
+  sqlite3_finalize(stmt);
+
+  if (ret != SQLITE_DONE)
+  {
+    delete idx;
+    return false;
+  }
+
+  idx->build();
+  delete _ds->index;
+  _ds->index = idx;
+
+  return true;
+#endif
 }
 
-bool GISDatabase::getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc)
+/**
+ * Find the lowest location elevation in a freshly opened dataset. Alternates
+ * can be found farther away the lower they are, so the candidate scan is
+ * sized from this. Anything that cannot be found out leaves lowestLandElev.
+ */
+static void lowestElevation(RecoveryDataset *_ds)
+{
+#ifndef NO_SPATIALITE
+  sqlite3 *db = (sqlite3*)_ds->dbhandle;
+  sqlite3_stmt *stmt;
+#endif
+  double elev = DBL_MAX;
+  size_t i;
+
+  _ds->minElev = lowestLandElev;
+
+  if (_ds->file != nullptr)
+  {
+    for (i = 0; i < _ds->file->size(); ++i)
+      elev = min(elev, _ds->file->record(i)->elev);
+
+    if (elev != DBL_MAX)
+      _ds->minElev = elev;
+
+    return;
+  }
+
+  if (_ds->table != nullptr)
+  {
+    if (_ds->table->getLowestElevation(elev) && elev != DBL_MAX)
+      _ds->minElev = elev;
+
+    return;
+  }
+
+#ifndef NO_SPATIALITE
+  if (db == nullptr)
+    return;
+
+  if (sqlite3_prepare_v2(db, "SELECT MIN(elev) FROM recovery", -1, &stmt, nullptr) != SQLITE_OK)
+    return;
+
+  if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+    _ds->minElev = sqlite3_column_double(stmt, 0);
+
+  sqlite3_finalize(stmt);
+#endif
+}
+
+static void closeDataset(RecoveryDataset *_ds)
+{
+  if (_ds == nullptr)
+    return;
+
+  closeSpatiaLite(_ds);
+  delete _ds->index;
+  delete _ds->file;
+  delete _ds->table;
+  delete _ds;
+}
+
+static RecoveryDataset* openDataset(const char *_dbPath, unsigned int _options)
+{
+  RecoveryDataset *ds = new RecoveryDataset();
+
+  memset(ds, 0, sizeof(*ds));
+
+  /**
+   * A flat recovery file is mapped and searched in place. It does not need
+   * SQLite, SpatiaLite, or an in-memory index.
+   */
+  if (RecoveryFile::isRecoveryFile(_dbPath))
+  {
+    ds->file = new RecoveryFile();
+
+    if (!ds->file->open(_dbPath))
+    {
+      closeDataset(ds);
+      return nullptr;
+    }
+
+    lowestElevation(ds);
+
+    return ds;
+  }
+
+  /**
+   * An R*Tree database is plain SQLite. Only fall back to SpatiaLite if the
+   * database does not have the R*Tree schema.
+   */
+  ds->table = new RecoveryTable();
+
+  if (!ds->table->open(_dbPath))
+  {
+    delete ds->table;
+    ds->table = nullptr;
+
+    if (!openSpatiaLite(ds, _dbPath))
+    {
+      closeDataset(ds);
+      return nullptr;
+    }
+  }
+
+  lowestElevation(ds);
+
+  if (_options & GISDatabase::optMemoryIndex)
+  {
+    /**
+     * Once the index is loaded, the database connection is no longer needed.
+     * Close it to release its cache. If the index fails to load, fall back to
+     * querying the database.
+     */
+    if (loadIndex(ds))
+    {
+      closeSpatiaLite(ds);
+      delete ds->table;
+      ds->table = nullptr;
+    }
+  }
+
+  return ds;
+}
+
+static bool findRecoveryLocation(RecoveryDataset *_ds, const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc)
 {
-  sqlite3 *db = (sqlite3*)dbhandle;
+#ifndef NO_SPATIALITE
+  sqlite3 *db;
   unsigned char *pposBlob;
-  const unsigned char *targetBlob;
-  int pposSize, targetSize;
+  int pposSize;
   double azMin, azMax;
-  gaiaGeomCollPtr g;
   sqlite3_stmt *stmt;
   int ret;
+#endif
 
   _loc.id = -1;
 
-  if (!isOpen())
+  if (_ds == nullptr)
+    return false;
+
+  if (_ds->file != nullptr)
+    return _ds->file->getRecoveryLocation(_ppos, _hdg, _maxDistance, _loc);
+
+  if (_ds->index != nullptr)
+    return _ds->index->getRecoveryLocation(_ppos, _hdg, _maxDistance, _loc);
+
+  if (_ds->table != nullptr)
+    return _ds->table->getRecoveryLocation(_ppos, _hdg, _maxDistance, _loc);
+
+#ifdef NO_SPATIALITE
+  return false;
+#else
+  if ((db = (sqlite3*)_ds->dbhandle) == nullptr)
     return false;
 
   /**
@@ -117,20 +549,557 @@ bool GISDatabase::getRecoveryLocation(const Loc &_ppos, double _hdg, double _max
   ret = sqlite3_step(stmt);
 
   if (ret == SQLITE_ROW)
+    readRecoveryLocation(stmt, _loc);
+
+  sqlite3_finalize(stmt);
+  free(pposBlob);
+
+  return (_loc.id >= 0);
+#endif
+}
+
+static void findLocationsWithin(RecoveryDataset *_ds, const Loc &_ppos, double _distance, vector<RecoveryLocation> &_locs)
+{
+#ifndef NO_SPATIALITE
+  sqlite3 *db;
+  RecoveryLocation loc;
+  unsigned char *pposBlob;
+  int pposSize;
+  sqlite3_stmt *stmt;
+  int ret;
+#endif
+
+  if (_ds == nullptr)
+    return;
+
+  if (_ds->file != nullptr)
   {
-    targetSize = sqlite3_column_bytes(stmt, 3);
-    targetBlob = (const unsigned char*)sqlite3_column_blob(stmt, 3);
-    g = gaiaFromSpatiaLiteBlobWkb(targetBlob, targetSize);
-    _loc.pos.lat = g->FirstPoint->Y;
-    _loc.pos.lon = g->FirstPoint->X;
-    _loc.elev = sqlite3_column_double(stmt, 2);
-    strncpy(_loc.ident, (const char*)sqlite3_column_text(stmt, 1), 8);
-    _loc.ident[8] = 0;
-    _loc.id = sqlite3_column_int64(stmt, 0);
+    _ds->file->getLocationsWithin(_ppos, _distance, _locs);
+    return;
+  }
+
+  if (_ds->index != nullptr)
+  {
+    _ds->index->getLocationsWithin(_ppos, _distance, _locs);
+    return;
+  }
+
+  if (_ds->table != nullptr)
+  {
+    _ds->table->getLocationsWithin(_ppos, _distance, _locs);
+    return;
+  }
+
+#ifndef NO_SPATIALITE
+  if ((db = (sqlite3*)_ds->dbhandle) == nullptr)
+    return;
+
+  ret = sqlite3_prepare_v2(
+   db,
+   "SELECT pkid, ident, elev, location FROM recovery "
+   "WHERE PtDistWithin(?1, location, ?2) = 1",
+   -1,
+   &stmt,
+   nullptr);
+
+  if (ret != SQLITE_OK)
+    return;
+
+  gaiaMakePoint(_ppos.lon, _ppos.lat, 4326, &pposBlob, &pposSize);
+
+  sqlite3_bind_blob(stmt, 1, pposBlob, pposSize, 0);
+  sqlite3_bind_double(stmt, 2, _distance * nm2m);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    readRecoveryLocation(stmt, loc);
+    _locs.push_back(loc);
   }
 
   sqlite3_finalize(stmt);
   free(pposBlob);
+#endif
+}
+
+void* GISDatabase::watchProc(void *_ptr)
+{
+  GISDatabase *db = static_cast<GISDatabase*>(_ptr);
+  string dir, name;
+  struct stat st, last;
+  useconds_t quiet = 0;
+  bool changed = false, exists;
+  size_t slash;
+#ifdef __linux__
+  char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *ev;
+  struct pollfd pfd;
+  ssize_t len;
+  char *p;
+  int fd, wd = -1;
+#endif
+
+  slash = db->dbPath.rfind('/');
+  dir = (slash == string::npos ? string(".") : db->dbPath.substr(0, slash + 1));
+  name = (slash == string::npos ? db->dbPath : db->dbPath.substr(slash + 1));
+
+  memset(&last, 0, sizeof(last));
+  exists = (stat(db->dbPath.c_str(), &last) == 0);
+
+#ifdef __linux__
+  /**
+   * Watch the directory rather than the file: a new database is normally
+   * built under another name and renamed over the old one, which replaces
+   * the inode a file watch would be attached to.
+   */
+  fd = inotify_init();
+
+  if (fd != -1)
+    wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+#endif
+
+  while (__sync_bool_compare_and_swap(&db->cancel, 0, 0))
+  {
+#ifdef __linux__
+    if (wd != -1)
+    {
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+
+      if (poll(&pfd, 1, watchInterval / 1000) > 0 && (len = read(fd, buf, sizeof(buf))) > 0)
+      {
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len)
+        {
+          ev = (const struct inotify_event*)p;
+
+          if (ev->len > 0 && name == ev->name)
+          {
+            changed = true;
+            quiet = 0;
+          }
+        }
+
+        continue;
+      }
+    }
+    else
+#endif
+    {
+      // No inotify; poll the file's identity instead.
+      usleep(watchInterval);
+
+      if (stat(db->dbPath.c_str(), &st) == 0 &&
+          (!exists || st.st_ino != last.st_ino || st.st_size != last.st_size || st.st_mtime != last.st_mtime))
+      {
+        last = st;
+        exists = true;
+        changed = true;
+        quiet = 0;
+        continue;
+      }
+    }
+
+    if (!changed || (quiet += watchInterval) < reloadDelay)
+      continue;
+
+    changed = false;
+    db->reload();
+  }
+
+#ifdef __linux__
+  if (fd != -1)
+    close(fd);
+#endif
+
+  pthread_exit(NULL);
+}
+
+GISDatabase::GISDatabase(const char *_dbPath, unsigned int _options)
+: dbPath(_dbPath),
+  options(_options),
+  current(nullptr),
+  epoch(0),
+  revision(0),
+  cancel(0),
+  watching(false),
+  watchThread(0),
+  publishLock(PTHREAD_MUTEX_INITIALIZER),
+  terrain(nullptr)
+{
+  readers[0] = 0;
+  readers[1] = 0;
+  current = openDataset(_dbPath, options);
+
+  if ((options & optWatch) && pthread_create(&watchThread, NULL, watchProc, this) == 0)
+    watching = true;
+}
+
+GISDatabase::~GISDatabase()
+{
+  if (watching)
+  {
+    __sync_bool_compare_and_swap(&cancel, 0, 1);
+    pthread_join(watchThread, NULL);
+  }
+
+  closeDataset(current);
+
+#ifndef NO_SPATIALITE
+  /**
+   * spatialite_shutdown() is process-wide. Call it only here, not when a
+   * reload closes the old dataset while the new one's connection is live.
+   */
+  spatialite_shutdown();
+#endif
+}
+
+RecoveryDataset* GISDatabase::acquire(unsigned int &_slot)
+{
+  /**
+   * Count the reader against the current epoch before loading the pointer.
+   * If the epoch moved on in between, count against the new one instead so
+   * that publish() can rely on the old epoch's count only ever falling.
+   */
+  while (true)
+  {
+    _slot = __sync_fetch_and_add(&epoch, 0) & 1;
+    __sync_fetch_and_add(&readers[_slot], 1);
+
+    if ((__sync_fetch_and_add(&epoch, 0) & 1) == _slot)
+      break;
+
+    __sync_fetch_and_sub(&readers[_slot], 1);
+  }
+
+  return __sync_val_compare_and_swap(&current, (RecoveryDataset*)nullptr, (RecoveryDataset*)nullptr);
+}
+
+void GISDatabase::release(unsigned int _slot)
+{
+  __sync_fetch_and_sub(&readers[_slot], 1);
+}
+
+void GISDatabase::publish(RecoveryDataset *_ds)
+{
+  RecoveryDataset *old;
+  unsigned int slot;
+
+  pthread_mutex_lock(&publishLock);
+
+  old = __sync_lock_test_and_set(&current, _ds);
+  __sync_fetch_and_add(&revision, 1);
+
+  /**
+   * Readers never wait; the publisher does. Any reader that might still hold
+   * the old dataset was counted against the old epoch. New readers count
+   * against the new epoch, so the old count drains even under constant load.
+   */
+  slot = __sync_fetch_and_add(&epoch, 1) & 1;
+
+  while (!__sync_bool_compare_and_swap(&readers[slot], 0, 0))
+    usleep(1000);
+
+  pthread_mutex_unlock(&publishLock);
+
+  closeDataset(old);
+}
+
+bool GISDatabase::reload()
+{
+  RecoveryDataset *ds;
+
+  // Build the new dataset, including any in-memory index, off to the side.
+  ds = openDataset(dbPath.c_str(), options);
+
+  if (ds == nullptr)
+    return false;
+
+  publish(ds);
+
+  return true;
+}
+
+bool GISDatabase::isOpen() const
+{
+  __sync_synchronize();
+  return (current != nullptr);
+}
+
+unsigned int GISDatabase::getRevision() const
+{
+  __sync_synchronize();
+  return revision;
+}
+
+void GISDatabase::setTerrain(Terrain *_terrain)
+{
+  terrain = _terrain;
+}
+
+bool GISDatabase::clearsTerrain(const Loc &_ppos, double _alt, double _maxDistance, const RecoveryLocation &_loc, bool &_known)
+{
+  double dis, brg, arrival, clearance;
+
+  _known = false;
+
+  if (terrain == nullptr)
+    return true;
+
+  /**
+   * The glide line runs from the present altitude down to the altitude at
+   * which the aircraft arrives over the location, using the glide ratio that
+   * _maxDistance implies for the location's elevation. If there is no terrain
+   * data along the line, give the location the benefit of the doubt.
+   */
+  getDistanceAndBearing(_ppos, _loc.pos, dis, brg);
+  arrival = (_maxDistance > 0.0 ? _alt - (_alt - _loc.elev) * dis / _maxDistance : _loc.elev);
+
+  if (!terrain->getMinClearance(_ppos, _alt, _loc.pos, arrival, clearance))
+    return true;
+
+  _known = true;
+
+  return (clearance >= minTerrainClearance);
+}
+
+bool GISDatabase::getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc)
+{
+  unsigned int slot;
+  bool ret;
+
+  ret = findRecoveryLocation(acquire(slot), _ppos, _hdg, _maxDistance, _loc);
+  release(slot);
+
+  return ret;
+}
+
+bool GISDatabase::getRecoveryLocation(const Loc &_ppos,
+                                      double _alt,
+                                      double _hdg,
+                                      double _maxDistance,
+                                      RecoveryLocation &_loc,
+                                      RecoveryRegion &_region)
+{
+  vector<RecoveryCandidate> cands;
+
+  return getRecoveryLocation(_ppos, _alt, _hdg, _maxDistance, 0.0, _loc, _region, 0, cands);
+}
+
+bool GISDatabase::getRecoveryLocation(const Loc &_ppos,
+                                      double _alt,
+                                      double _hdg,
+                                      double _maxDistance,
+                                      double _elev,
+                                      RecoveryLocation &_loc,
+                                      RecoveryRegion &_region,
+                                      size_t _count,
+                                      vector<RecoveryCandidate> &_cands,
+                                      RecoveryCostFunction _cost,
+                                      void *_arg)
+{
+  vector<RecoveryLocation> locs;
+  vector<RegionCandidate> cands;
+  vector<size_t> eligible;
+  const RegionCandidate *best = nullptr;
+  double scan, lo, hi, mid;
+  bool known, terrainKnown = false;
+  size_t i;
+
+  _loc.id = -1;
+  _region.pos = _ppos;
+  _region.radius = -1.0;
+  _region.hdg = _hdg;
+  _region.hdgTolerance = 0.0;
+  _region.minDistance = _maxDistance;
+  _region.maxDistance = _maxDistance;
+  _cands.clear();
+
+  if (!isOpen())
+    return false;
+
+  /**
+   * Gather every location that could matter anywhere in the largest region,
+   * or as far out as the lowest location in the data could be reached. Then
+   * pick the answer from that list so that the answer and the region are
+   * computed with exactly the same geometry. The alternates are ranked from
+   * the same list.
+   */
+  scan = _maxDistance + 2.0 * maxRegionRadius;
+
+  if (_count > 0)
+    scan = max(scan, reachDistance(_alt, _maxDistance, _elev, min(_elev, getMinElevation())));
+
+  getLocationsWithin(_ppos, scan, locs);
+  measureLocations(_ppos, _hdg, locs, cands);
+
+  for (i = 0; i < cands.size(); ++i)
+  {
+    if (cands[i].dis <= _maxDistance && cands[i].off <= sectorHalfAngle)
+      eligible.push_back(i);
+  }
+
+  if (_count > 0)
+    rankCandidates(_ppos, _alt, _maxDistance, _elev, locs, cands, _count, _cands, _cost, _arg);
+
+  /**
+   * Take the nearest location whose glide clears the terrain. The clearance
+   * changes with altitude as well as position, so there is no region to
+   * certify once terrain has decided anything.
+   */
+  stable_sort(eligible.begin(), eligible.end(),
+    [&cands](size_t _a, size_t _b) { return cands[_a].dis < cands[_b].dis; });
+
+  for (i = 0; i < eligible.size(); ++i)
+  {
+    bool clear = clearsTerrain(_ppos, _alt, _maxDistance, locs[eligible[i]], known);
+
+    terrainKnown = terrainKnown || known;
+
+    if (clear)
+    {
+      best = &cands[eligible[i]];
+      _loc = locs[eligible[i]];
+      break;
+    }
+  }
+
+  if (terrainKnown)
+    return (_loc.id >= 0);
+
+  /**
+   * Certify the largest radius, up to maxRegionRadius, for the widest track
+   * tolerance that admits one. Validity is monotonic in the radius, so a
+   * bisection finds it.
+   */
+  for (i = 0; i < COUNTOF(regionHdgTolerances); ++i)
+  {
+    if (!regionIsValid(_ppos, _maxDistance, cands, best, 0.0, regionHdgTolerances[i]))
+      continue;
+
+    lo = 0.0;
+    hi = maxRegionRadius;
+
+    if (regionIsValid(_ppos, _maxDistance, cands, best, hi, regionHdgTolerances[i]))
+      lo = hi;
+
+    while (hi - lo > 0.01)
+    {
+      mid = (lo + hi) / 2.0;
+
+      if (regionIsValid(_ppos, _maxDistance, cands, best, mid, regionHdgTolerances[i]))
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+    _region.radius = lo;
+    _region.hdgTolerance = regionHdgTolerances[i];
+    _region.minDistance = _maxDistance - lo;
+    _region.maxDistance = _maxDistance + lo;
+    break;
+  }
 
   return (_loc.id >= 0);
 }
+
+void GISDatabase::rankCandidates(const Loc &_ppos,
+                                 double _alt,
+                                 double _maxDistance,
+                                 double _elev,
+                                 const vector<RecoveryLocation> &_locs,
+                                 const vector<RegionCandidate> &_measured,
+                                 size_t _count,
+                                 vector<RecoveryCandidate> &_cands,
+                                 RecoveryCostFunction _cost,
+                                 void *_arg)
+{
+  vector<RecoveryCandidate> scored;
+  RecoveryCandidate c;
+  double agl, reach;
+  bool known;
+  size_t i;
+
+  _cands.clear();
+
+  if (_cost == nullptr)
+    _cost = recoveryDistanceCost;
+
+  /**
+   * Score every location within the sector about the ground track that is in
+   * reach given its own elevation, and keep the best _count of them whose
+   * glide clears the terrain.
+   */
+  for (i = 0; i < _locs.size(); ++i)
+  {
+    const RegionCandidate &m = _measured[i];
+
+    reach = reachDistance(_alt, _maxDistance, _elev, _locs[i].elev);
+
+    if (m.dis > reach || m.off > sectorHalfAngle)
+      continue;
+
+    c.loc = _locs[i];
+    c.distance = m.dis;
+    c.bearing = m.brg;
+    agl = _alt - c.loc.elev;
+    c.glideRatio = (agl > 0.0 ? c.distance * nm2ft / agl : DBL_MAX);
+    c.cost = (*_cost)(c, _arg);
+    scored.push_back(c);
+  }
+
+  stable_sort(scored.begin(), scored.end(),
+    [](const RecoveryCandidate &_a, const RecoveryCandidate &_b) { return _a.cost < _b.cost; });
+
+  for (i = 0; i < scored.size() && _cands.size() < _count; ++i)
+  {
+    reach = reachDistance(_alt, _maxDistance, _elev, scored[i].loc.elev);
+
+    if (clearsTerrain(_ppos, _alt, reach, scored[i].loc, known))
+      _cands.push_back(scored[i]);
+  }
+}
+
+size_t GISDatabase::getRecoveryCandidates(const Loc &_ppos,
+                                          double _alt,
+                                          double _hdg,
+                                          double _maxDistance,
+                                          double _elev,
+                                          size_t _count,
+                                          vector<RecoveryCandidate> &_cands,
+                                          RecoveryCostFunction _cost,
+                                          void *_arg)
+{
+  vector<RecoveryLocation> locs;
+  vector<RegionCandidate> measured;
+
+  getLocationsWithin(_ppos, max(reachDistance(_alt, _maxDistance, _elev, min(_elev, getMinElevation())), 0.0), locs);
+  measureLocations(_ppos, _hdg, locs, measured);
+  rankCandidates(_ppos, _alt, _maxDistance, _elev, locs, measured, _count, _cands, _cost, _arg);
+
+  return _cands.size();
+}
+
+/**
+ * The lowest location elevation in the current data. The scan sized from it
+ * may run against newer data after a reload; that only costs an alternate
+ * that was not there to be found.
+ */
+double GISDatabase::getMinElevation()
+{
+  RecoveryDataset *ds;
+  unsigned int slot;
+  double elev;
+
+  ds = acquire(slot);
+  elev = (ds != nullptr ? ds->minElev : lowestLandElev);
+  release(slot);
+
+  return elev;
+}
+
+void GISDatabase::getLocationsWithin(const Loc &_ppos, double _distance, vector<RecoveryLocation> &_locs)
+{
+  unsigned int slot;
+
+  findLocationsWithin(acquire(slot), _ppos, _distance, _locs);
+  release(slot);
+}
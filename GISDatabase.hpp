@@ -2,7 +2,9 @@
 #define GISDatabase_hpp
 
 #include <sys/types.h>
+#include <pthread.h>
 #include <string>
+#include <vector>
 #include "DataSource.hpp"
 
 struct RecoveryLocation
@@ -10,30 +12,185 @@ struct RecoveryLocation
   int64_t id;
   char ident[9];
   Loc pos;
+  NVector nv;       // n-vector of pos
   double elev;
 };
 
+/**
+ * A recovery location ranked by getRecoveryCandidates(). The required glide
+ * ratio is the distance over the height above the location's elevation, or
+ * DBL_MAX if the aircraft is not above the location.
+ */
+struct RecoveryCandidate
+{
+  RecoveryLocation loc;
+  double distance;    // nm
+  double bearing;     // degrees
+  double glideRatio;
+  double cost;
+};
+
+/**
+ * Ranks recovery candidates for getRecoveryCandidates(); lower is better.
+ * recoveryDistanceCost() ranks by distance, recoveryGlideRatioCost() ranks by
+ * required glide ratio.
+ */
+typedef double (*RecoveryCostFunction)(const RecoveryCandidate &_cand, void *_arg);
+
+double recoveryDistanceCost(const RecoveryCandidate &_cand, void *_arg);
+
+double recoveryGlideRatioCost(const RecoveryCandidate &_cand, void *_arg);
+
+/**
+ * A conservative region around a recovery location query within which the
+ * answer cannot change: the present position within `radius' nm of `pos',
+ * the ground track within `hdgTolerance' degrees of `hdg', and the glide
+ * distance within [minDistance, maxDistance]. A negative radius means the
+ * region is empty.
+ */
+struct RecoveryRegion
+{
+  Loc pos;
+  double radius;
+  double hdg;
+  double hdgTolerance;
+  double minDistance;
+  double maxDistance;
+
+  bool contains(const Loc &_ppos, double _hdg, double _maxDistance) const;
+};
+
+struct RecoveryDataset;
+struct RegionCandidate;
+class Terrain;
+
+/**
+ * With optWatch, the database watches its file and reloads it in a background
+ * thread after it changes. Build the new database under another name and
+ * rename it over the old one; a file that is rewritten in place may be seen
+ * half-written, and a flat file may be mapped by queries in flight. If the new
+ * file fails to open, the old data stays in use.
+ *
+ * The reloaded data, including any in-memory index, is built completely before
+ * it replaces the old data with a single atomic pointer swap. Queries never
+ * wait for a reload; each one sees either the old data or the new, never a
+ * mix. getRevision() changes after every swap so that callers can drop cached
+ * answers.
+ */
 class GISDatabase
 {
 public:
-  GISDatabase(const char *_dbPath);
+  enum Options
+  {
+    optNone         = 0x0,
+    optMemoryIndex  = 0x1, // Load all locations into a RecoveryIndex at open.
+    optWatch        = 0x2  // Reload the database when its file changes.
+  };
+
+private:
+  static void* watchProc(void *_ptr);
+
+public:
+  GISDatabase(const char *_dbPath, unsigned int _options = optNone);
 
 public:
   ~GISDatabase();
 
 private:
-  bool openDatabase(const char *_dbPath);
+  RecoveryDataset* acquire(unsigned int &_slot);
+
+  void release(unsigned int _slot);
+
+  void publish(RecoveryDataset *_ds);
 
-  void closeDatabase();
+  double getMinElevation();
+
+  bool clearsTerrain(const Loc &_ppos, double _alt, double _maxDistance, const RecoveryLocation &_loc, bool &_known);
+
+  void rankCandidates(const Loc &_ppos,
+                      double _alt,
+                      double _maxDistance,
+                      double _elev,
+                      const std::vector<RecoveryLocation> &_locs,
+                      const std::vector<RegionCandidate> &_measured,
+                      size_t _count,
+                      std::vector<RecoveryCandidate> &_cands,
+                      RecoveryCostFunction _cost,
+                      void *_arg);
 
 public:
   bool isOpen() const;
 
+  bool reload();
+
+  unsigned int getRevision() const;
+
+  /**
+   * With terrain, a location is only taken if the glide to it clears the
+   * terrain along the way. Leave it out unless that check is wanted: the
+   * clearance depends on altitude as well as position, so no RecoveryRegion
+   * is certified once terrain data has decided anything, and RecoveryWorker
+   * must go to the database on every request over terrain with tile coverage.
+   *
+   * The database does not own the terrain, which must outlive it. The same
+   * instance may be shared with FlightDirector.
+   */
+  void setTerrain(Terrain *_terrain);
+
   bool getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc);
 
+  bool getRecoveryLocation(const Loc &_ppos,
+                           double _alt,
+                           double _hdg,
+                           double _maxDistance,
+                           RecoveryLocation &_loc,
+                           RecoveryRegion &_region);
+
+  /**
+   * Also ranks up to _count alternates from the same neighbourhood scan, as
+   * getRecoveryCandidates() would.
+   */
+  bool getRecoveryLocation(const Loc &_ppos,
+                           double _alt,
+                           double _hdg,
+                           double _maxDistance,
+                           double _elev,
+                           RecoveryLocation &_loc,
+                           RecoveryRegion &_region,
+                           size_t _count,
+                           std::vector<RecoveryCandidate> &_cands,
+                           RecoveryCostFunction _cost = recoveryDistanceCost,
+                           void *_arg = nullptr);
+
+  /**
+   * _maxDistance is the glide distance down to elevation _elev. A location is
+   * in reach if it is within that glide rescaled to the height above its own
+   * elevation, so lower locations may be farther away than _maxDistance.
+   */
+  size_t getRecoveryCandidates(const Loc &_ppos,
+                               double _alt,
+                               double _hdg,
+                               double _maxDistance,
+                               double _elev,
+                               size_t _count,
+                               std::vector<RecoveryCandidate> &_cands,
+                               RecoveryCostFunction _cost = recoveryDistanceCost,
+                               void *_arg = nullptr);
+
+  void getLocationsWithin(const Loc &_ppos, double _distance, std::vector<RecoveryLocation> &_locs);
+
 private:
-  void *dbhandle;
-  void *cache;
+  std::string dbPath;
+  unsigned int options;
+  RecoveryDataset *current;
+  long readers[2];
+  unsigned int epoch;
+  unsigned int revision;
+  long cancel;
+  bool watching;
+  pthread_t watchThread;
+  pthread_mutex_t publishLock;
+  Terrain *terrain;
 };
 
 #endif
@@ -0,0 +1,69 @@
+#ifndef Handoff_hpp
+#define Handoff_hpp
+
+/**
+ * Handoff passes the latest value of T from one writer thread to one reader
+ * thread without locks, as a triple buffer. The writer fills its back slot
+ * and exchanges it for the middle slot; the reader, if the middle slot holds
+ * something newer than its front slot, exchanges the two. Neither side ever
+ * waits, and the reader always sees a complete value: the most recent one
+ * published before its read, or an older one if it has not read since.
+ *
+ * T should be small and trivially copyable; it is copied on every publish().
+ */
+template <typename T>
+class Handoff
+{
+public:
+  Handoff(const T &_initial = T())
+  : back(0),
+    middle(1),
+    front(2)
+  {
+    slots[0] = slots[1] = slots[2] = _initial;
+  }
+
+public:
+  /**
+   * Writer side.
+   */
+  void publish(const T &_value)
+  {
+    slots[back] = _value;
+
+    // Make the slot contents visible before the slot is handed over.
+    __sync_synchronize();
+    back = __sync_lock_test_and_set(&middle, back | fresh) & indexMask;
+  }
+
+  /**
+   * Reader side. Copies the latest value to _value and returns true if it is
+   * new since the last read.
+   */
+  bool read(T &_value)
+  {
+    bool isNew = false;
+
+    if ((__sync_fetch_and_add(&middle, 0) & fresh) != 0)
+    {
+      front = __sync_lock_test_and_set(&middle, front) & indexMask;
+      __sync_synchronize();
+      isNew = true;
+    }
+
+    _value = slots[front];
+    return isNew;
+  }
+
+private:
+  static const int indexMask = 0x3;
+  static const int fresh = 0x4;
+
+private:
+  T slots[3];
+  int back;     // writer only
+  int middle;   // shared; a slot index, plus `fresh' if the writer filled it
+  int front;    // reader only
+};
+
+#endif
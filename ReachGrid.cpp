@@ -0,0 +1,164 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cfloat>
+#include <cstring>
+#include "ReachGrid.hpp"
+
+size_t ReachGrid::cellCount(const ReachGridHeader &_header)
+{
+  size_t t = _header.tileSize;
+  size_t tileRows = (_header.rows + t - 1) / t, tileCols = (_header.cols + t - 1) / t;
+
+  return tileRows * tileCols * t * t;
+}
+
+size_t ReachGrid::cellIndex(const ReachGridHeader &_header, u_int32_t _row, u_int32_t _col)
+{
+  size_t t = _header.tileSize, tileCols = (_header.cols + t - 1) / t;
+  size_t tile = (_row / t) * tileCols + _col / t;
+
+  return tile * t * t + (_row % t) * t + _col % t;
+}
+
+ReachGrid::ReachGrid()
+: map(nullptr),
+  mapSize(0),
+  header(nullptr),
+  sites(nullptr),
+  cells(nullptr)
+{
+
+}
+
+ReachGrid::~ReachGrid()
+{
+  close();
+}
+
+bool ReachGrid::open(const char *_path)
+{
+  struct stat st;
+  const ReachGridHeader *h;
+  void *m;
+  int fd;
+
+  close();
+
+  fd = ::open(_path, O_RDONLY);
+
+  if (fd == -1)
+    return false;
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ReachGridHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (m == MAP_FAILED)
+    return false;
+
+  h = (const ReachGridHeader*)m;
+
+  if (memcmp(h->magic, REACH_GRID_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != REACH_GRID_VERSION ||
+      h->byteOrder != REACH_GRID_BYTE_ORDER ||
+      h->cellSize <= 0.0 ||
+      h->glideRatio <= 0.0 ||
+      h->tileSize == 0 ||
+      h->siteOffset + (u_int64_t)h->siteCount * sizeof(ReachGridSite) > (u_int64_t)st.st_size ||
+      h->cellOffset + (u_int64_t)cellCount(*h) * sizeof(ReachGridCell) > (u_int64_t)st.st_size)
+  {
+    munmap(m, (size_t)st.st_size);
+    return false;
+  }
+
+  madvise(m, (size_t)st.st_size, MADV_RANDOM);
+
+  map = m;
+  mapSize = (size_t)st.st_size;
+  header = h;
+  sites = (const ReachGridSite*)((const char*)m + h->siteOffset);
+  cells = (const ReachGridCell*)((const char*)m + h->cellOffset);
+
+  return true;
+}
+
+void ReachGrid::close()
+{
+  if (map == nullptr)
+    return;
+
+  munmap(map, mapSize);
+
+  map = nullptr;
+  mapSize = 0;
+  header = nullptr;
+  sites = nullptr;
+  cells = nullptr;
+}
+
+bool ReachGrid::isOpen() const
+{
+  return (map != nullptr);
+}
+
+double ReachGrid::glideRatio() const
+{
+  return (header != nullptr ? header->glideRatio : 0.0);
+}
+
+bool ReachGrid::getRequiredAltitude(const Loc &_pos, double &_alt, RecoveryLocation &_loc) const
+{
+  const ReachGridCell *cell;
+  const ReachGridSite *site;
+  double row, col;
+
+  _loc.id = -1;
+  _alt = DBL_MAX;
+
+  if (!isOpen())
+    return false;
+
+  row = floor((_pos.lat - header->south) / header->cellSize);
+  col = floor((_pos.lon - header->west) / header->cellSize);
+
+  if (row < 0.0 || row >= header->rows || col < 0.0 || col >= header->cols)
+    return false;
+
+  cell = &cells[cellIndex(*header, (u_int32_t)row, (u_int32_t)col)];
+
+  if (cell->site >= header->siteCount)
+    return false;
+
+  site = &sites[cell->site];
+
+  _alt = cell->alt;
+  _loc.id = site->id;
+  strncpy(_loc.ident, site->ident, 8);
+  _loc.ident[8] = 0;
+  _loc.pos.lat = site->lat;
+  _loc.pos.lon = site->lon;
+  toNVector(_loc.pos, _loc.nv);
+  _loc.elev = site->elev;
+
+  return true;
+}
+
+bool ReachGrid::getReachableLocation(const Loc &_pos, double _alt, RecoveryLocation &_loc) const
+{
+  double req;
+
+  if (!getRequiredAltitude(_pos, req, _loc) || _alt < req)
+  {
+    _loc.id = -1;
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,97 @@
+#ifndef ReachGrid_hpp
+#define ReachGrid_hpp
+
+#include <sys/types.h>
+#include <cstddef>
+#include "GISDatabase.hpp"
+
+/**
+ * Reachability grid format written by reachtool.
+ *
+ * The grid covers a lat/lon box in square cells of `cellSize' degrees. Each
+ * cell holds the least altitude, in feet MSL, from which the best recovery
+ * location can be reached at the reference glide ratio without the glide
+ * hitting terrain, along with the index of that location in the site table.
+ * Cells are stored in square tiles of `tileSize' cells so that neighbouring
+ * cells share pages. Row 0 is the south edge and column 0 is the west edge.
+ * All values are in native byte order.
+ */
+
+#define REACH_GRID_MAGIC          "OTTOREQ"
+#define REACH_GRID_VERSION        1
+#define REACH_GRID_BYTE_ORDER     0x01020304
+#define REACH_GRID_TILE_SIZE      32
+#define REACH_GRID_NO_SITE        0xffffffffu
+
+struct ReachGridHeader
+{
+  char magic[8];
+  u_int32_t version;
+  u_int32_t byteOrder;
+  double south;           // degrees
+  double west;            // degrees
+  double cellSize;        // degrees
+  double glideRatio;
+  u_int32_t rows;
+  u_int32_t cols;
+  u_int32_t tileSize;     // cells on a side
+  u_int32_t siteCount;
+  u_int64_t siteOffset;
+  u_int64_t cellOffset;
+};
+
+struct ReachGridSite
+{
+  int64_t id;
+  char ident[16];
+  double elev;            // feet
+  double lat;             // degrees
+  double lon;             // degrees
+};
+
+struct ReachGridCell
+{
+  float alt;              // feet MSL, FLT_MAX if nothing is in reach
+  u_int32_t site;         // REACH_GRID_NO_SITE if nothing is in reach
+};
+
+/**
+ * The ReachGrid class maps a reachability grid read-only and answers "can I
+ * reach anything from here, and which?" with a single cell lookup. Lookups do
+ * not modify the grid, so any number of threads may share one.
+ */
+class ReachGrid
+{
+public:
+  static size_t cellCount(const ReachGridHeader &_header);
+
+  static size_t cellIndex(const ReachGridHeader &_header, u_int32_t _row, u_int32_t _col);
+
+public:
+  ReachGrid();
+
+public:
+  ~ReachGrid();
+
+public:
+  bool open(const char *_path);
+
+  void close();
+
+  bool isOpen() const;
+
+  double glideRatio() const;
+
+  bool getRequiredAltitude(const Loc &_pos, double &_alt, RecoveryLocation &_loc) const;
+
+  bool getReachableLocation(const Loc &_pos, double _alt, RecoveryLocation &_loc) const;
+
+private:
+  void *map;
+  size_t mapSize;
+  const ReachGridHeader *header;
+  const ReachGridSite *sites;
+  const ReachGridCell *cells;
+};
+
+#endif
@@ -0,0 +1,332 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "RecoveryFile.hpp"
+#include "Utilities.hpp"
+
+using namespace std;
+
+static u_int32_t gridRows(double _cellSize)
+{
+  return (u_int32_t)ceil(180.0 / _cellSize);
+}
+
+static u_int32_t gridCols(double _cellSize)
+{
+  return (u_int32_t)ceil(360.0 / _cellSize);
+}
+
+bool RecoveryFile::isRecoveryFile(const char *_path)
+{
+  char magic[8];
+  FILE *file;
+  size_t bytes;
+
+  file = fopen(_path, "rb");
+
+  if (file == nullptr)
+    return false;
+
+  bytes = fread(magic, 1, sizeof(magic), file);
+  fclose(file);
+
+  return (bytes == sizeof(magic) && memcmp(magic, RECOVERY_FILE_MAGIC, sizeof(magic)) == 0);
+}
+
+u_int32_t RecoveryFile::gridOrder(double _cellSize)
+{
+  u_int32_t n = max(gridRows(_cellSize), gridCols(_cellSize)), order = 0;
+
+  while ((1u << order) < n)
+    ++order;
+
+  return order;
+}
+
+u_int32_t RecoveryFile::cellKey(u_int32_t _row, u_int32_t _col, u_int32_t _order)
+{
+  /**
+   * Standard Hilbert curve mapping from (x, y) to distance along the curve for
+   * a 2^_order x 2^_order grid. Columns are x, rows are y.
+   */
+  u_int32_t n = 1u << _order, x = _col, y = _row, rx, ry, s, t, d = 0;
+
+  for (s = n / 2; s > 0; s /= 2)
+  {
+    rx = (x & s) > 0;
+    ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+
+    if (ry == 0)
+    {
+      if (rx == 1)
+      {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+
+      t = x;
+      x = y;
+      y = t;
+    }
+  }
+
+  return d;
+}
+
+u_int32_t RecoveryFile::cellKey(const Loc &_pos, double _cellSize, u_int32_t _order)
+{
+  u_int32_t rows = gridRows(_cellSize), cols = gridCols(_cellSize);
+  int row = (int)floor((_pos.lat + 90.0) / _cellSize);
+  int col = (int)floor((_pos.lon + 180.0) / _cellSize);
+
+  row = ::clamp(row, 0, (int)rows - 1);
+  col = ::clamp(col, 0, (int)cols - 1);
+
+  return cellKey((u_int32_t)row, (u_int32_t)col, _order);
+}
+
+RecoveryFile::RecoveryFile()
+: map(nullptr),
+  mapSize(0),
+  header(nullptr),
+  cells(nullptr),
+  records(nullptr)
+{
+
+}
+
+RecoveryFile::~RecoveryFile()
+{
+  close();
+}
+
+bool RecoveryFile::open(const char *_path)
+{
+  struct stat st;
+  const RecoveryFileHeader *h;
+  void *m;
+  int fd;
+
+  close();
+
+  fd = ::open(_path, O_RDONLY);
+
+  if (fd == -1)
+    return false;
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RecoveryFileHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (m == MAP_FAILED)
+    return false;
+
+  h = (const RecoveryFileHeader*)m;
+
+  if (memcmp(h->magic, RECOVERY_FILE_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != RECOVERY_FILE_VERSION ||
+      h->byteOrder != RECOVERY_FILE_BYTE_ORDER ||
+      h->cellSize <= 0.0 ||
+      h->gridOrder != gridOrder(h->cellSize) ||
+      h->cellOffset + (u_int64_t)h->cellCount * sizeof(RecoveryFileCell) > (u_int64_t)st.st_size ||
+      h->recordOffset + (u_int64_t)h->recordCount * sizeof(RecoveryFileRecord) > (u_int64_t)st.st_size)
+  {
+    munmap(m, (size_t)st.st_size);
+    return false;
+  }
+
+  /**
+   * Queries jump around the file by cell. Tell the kernel not to bother with
+   * read-ahead so that only the pages we actually touch are read.
+   */
+  madvise(m, (size_t)st.st_size, MADV_RANDOM);
+
+  map = m;
+  mapSize = (size_t)st.st_size;
+  header = h;
+  cells = (const RecoveryFileCell*)((const char*)m + h->cellOffset);
+  records = (const RecoveryFileRecord*)((const char*)m + h->recordOffset);
+
+  return true;
+}
+
+void RecoveryFile::close()
+{
+  if (map == nullptr)
+    return;
+
+  munmap(map, mapSize);
+
+  map = nullptr;
+  mapSize = 0;
+  header = nullptr;
+  cells = nullptr;
+  records = nullptr;
+}
+
+bool RecoveryFile::isOpen() const
+{
+  return (map != nullptr);
+}
+
+size_t RecoveryFile::size() const
+{
+  return (header != nullptr ? header->recordCount : 0);
+}
+
+const RecoveryFileRecord* RecoveryFile::record(size_t _i) const
+{
+  return (_i < size() ? &records[_i] : nullptr);
+}
+
+void RecoveryFile::toRecoveryLocation(const RecoveryFileRecord *_rec, RecoveryLocation &_loc)
+{
+  _loc.id = _rec->id;
+  strncpy(_loc.ident, _rec->ident, 8);
+  _loc.ident[8] = 0;
+  _loc.pos.lat = _rec->lat;
+  _loc.pos.lon = _rec->lon;
+  _loc.nv.x = _rec->v[0];
+  _loc.nv.y = _rec->v[1];
+  _loc.nv.z = _rec->v[2];
+  _loc.elev = _rec->elev;
+}
+
+void RecoveryFile::cellRange(const Loc &_ppos, double _distance, int &_rowMin, int &_rowMax, int &_colMin, int &_colMax) const
+{
+  double cs = header->cellSize, theta, x, dLon;
+  int rows = (int)gridRows(cs), cols = (int)gridCols(cs);
+
+  /**
+   * Find the range of cells covering the search radius. If the radius covers a
+   * pole or the longitude extent covers the whole globe, search every column.
+   * Columns outside of [0, cols) wrap around the antimeridian.
+   */
+  theta = radToDeg(min(max(_distance, 0.0) / earthRadius, M_PI));
+
+  _rowMin = ::clamp((int)floor((_ppos.lat - theta + 90.0) / cs), 0, rows - 1);
+  _rowMax = ::clamp((int)floor((_ppos.lat + theta + 90.0) / cs), 0, rows - 1);
+  _colMin = 0;
+  _colMax = cols - 1;
+
+  if (_ppos.lat - theta > -90.0 && _ppos.lat + theta < 90.0)
+  {
+    x = sin(degToRad(theta)) / cos(degToRad(_ppos.lat));
+
+    if (x < 1.0)
+    {
+      dLon = radToDeg(asin(x));
+      _colMin = (int)floor((_ppos.lon - dLon + 180.0) / cs);
+      _colMax = (int)floor((_ppos.lon + dLon + 180.0) / cs);
+
+      if (_colMax - _colMin + 1 >= cols)
+      {
+        _colMin = 0;
+        _colMax = cols - 1;
+      }
+    }
+  }
+}
+
+const RecoveryFileCell* RecoveryFile::findCell(int _row, int _col) const
+{
+  const RecoveryFileCell *end = cells + header->cellCount, *c;
+  int cols = (int)gridCols(header->cellSize);
+  u_int32_t key;
+
+  key = cellKey((u_int32_t)_row, (u_int32_t)(((_col % cols) + cols) % cols), header->gridOrder);
+  c = lower_bound(cells, end, key,
+        [](const RecoveryFileCell &_c, u_int32_t _k) { return _c.key < _k; });
+
+  if (c == end || c->key != key || c->first + (u_int64_t)c->count > header->recordCount)
+    return nullptr;
+
+  return c;
+}
+
+bool RecoveryFile::getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc) const
+{
+  RecoveryQuery q(_ppos, _hdg, _maxDistance);
+  const RecoveryFileCell *cell;
+  const RecoveryFileRecord *r, *rec = nullptr;
+  double best = q.maxChord2, d2;
+  int rowMin, rowMax, colMin, colMax, row, col;
+  u_int32_t i;
+
+  _loc.id = -1;
+
+  if (!isOpen())
+    return false;
+
+  cellRange(_ppos, _maxDistance, rowMin, rowMax, colMin, colMax);
+
+  for (row = rowMin; row <= rowMax; ++row)
+  {
+    for (col = colMin; col <= colMax; ++col)
+    {
+      if ((cell = findCell(row, col)) == nullptr)
+        continue;
+
+      for (i = 0, r = &records[cell->first]; i < cell->count; ++i, ++r)
+      {
+        d2 = q.chord2(r->v);
+
+        if (d2 <= best && q.inSector(r->v))
+        {
+          best = d2;
+          rec = r;
+        }
+      }
+    }
+  }
+
+  if (rec == nullptr)
+    return false;
+
+  toRecoveryLocation(rec, _loc);
+
+  return true;
+}
+
+void RecoveryFile::getLocationsWithin(const Loc &_ppos, double _distance, std::vector<RecoveryLocation> &_locs) const
+{
+  RecoveryQuery q(_ppos, 0.0, _distance);
+  const RecoveryFileCell *cell;
+  const RecoveryFileRecord *r;
+  RecoveryLocation loc;
+  int rowMin, rowMax, colMin, colMax, row, col;
+  u_int32_t i;
+
+  if (!isOpen())
+    return;
+
+  cellRange(_ppos, _distance, rowMin, rowMax, colMin, colMax);
+
+  for (row = rowMin; row <= rowMax; ++row)
+  {
+    for (col = colMin; col <= colMax; ++col)
+    {
+      if ((cell = findCell(row, col)) == nullptr)
+        continue;
+
+      for (i = 0, r = &records[cell->first]; i < cell->count; ++i, ++r)
+      {
+        if (q.chord2(r->v) <= q.maxChord2)
+        {
+          toRecoveryLocation(r, loc);
+          _locs.push_back(loc);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef RecoveryFile_hpp
+#define RecoveryFile_hpp
+
+#include <sys/types.h>
+#include <cstddef>
+#include <vector>
+#include "GISDatabase.hpp"
+#include "RecoveryQuery.hpp"
+
+/**
+ * Flat recovery database format written by rdbtool --format flat.
+ *
+ * The file is a header, a cell directory, and an array of fixed-size records,
+ * all in native byte order. The world is divided into square lat/lon cells of
+ * `cellSize' degrees. Records are sorted by the Hilbert curve index of their
+ * cell so that nearby locations are stored near each other in the file. The
+ * directory has one entry per non-empty cell, sorted by key, giving the range
+ * of records in that cell.
+ */
+
+#define RECOVERY_FILE_MAGIC       "OTTORDB"
+#define RECOVERY_FILE_VERSION     1
+#define RECOVERY_FILE_BYTE_ORDER  0x01020304
+#define RECOVERY_FILE_CELL_SIZE   1.0
+
+struct RecoveryFileHeader
+{
+  char magic[8];
+  u_int32_t version;
+  u_int32_t byteOrder;
+  double cellSize;        // degrees
+  u_int32_t gridOrder;    // the Hilbert grid is 2^gridOrder cells on a side
+  u_int32_t cellCount;
+  u_int32_t recordCount;
+  u_int32_t reserved;
+  u_int64_t cellOffset;
+  u_int64_t recordOffset;
+};
+
+struct RecoveryFileCell
+{
+  u_int32_t key;
+  u_int32_t first;
+  u_int32_t count;
+  u_int32_t reserved;
+};
+
+struct RecoveryFileRecord
+{
+  int64_t id;
+  char ident[16];
+  double elev;            // feet
+  double lat;             // degrees
+  double lon;             // degrees
+  double v[3];            // unit vector
+};
+
+/**
+ * The RecoveryFile class maps a flat recovery database read-only and searches
+ * it in place. Only the directory and the records of the cells near the query
+ * are touched, so only those pages are read from disk.
+ */
+class RecoveryFile
+{
+public:
+  static bool isRecoveryFile(const char *_path);
+
+  static u_int32_t gridOrder(double _cellSize);
+
+  static u_int32_t cellKey(u_int32_t _row, u_int32_t _col, u_int32_t _order);
+
+  static u_int32_t cellKey(const Loc &_pos, double _cellSize, u_int32_t _order);
+
+public:
+  RecoveryFile();
+
+public:
+  ~RecoveryFile();
+
+public:
+  bool open(const char *_path);
+
+  void close();
+
+  bool isOpen() const;
+
+  size_t size() const;
+
+  const RecoveryFileRecord* record(size_t _i) const;
+
+  bool getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc) const;
+
+  void getLocationsWithin(const Loc &_ppos, double _distance, std::vector<RecoveryLocation> &_locs) const;
+
+private:
+  void cellRange(const Loc &_ppos, double _distance, int &_rowMin, int &_rowMax, int &_colMin, int &_colMax) const;
+
+  const RecoveryFileCell* findCell(int _row, int _col) const;
+
+  static void toRecoveryLocation(const RecoveryFileRecord *_rec, RecoveryLocation &_loc);
+
+private:
+  void *map;
+  size_t mapSize;
+  const RecoveryFileHeader *header;
+  const RecoveryFileCell *cells;
+  const RecoveryFileRecord *records;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cfloat>
+#include "RecoveryIndex.hpp"
+#include "Utilities.hpp"
+
+using namespace std;
+
+RecoveryIndex::RecoveryIndex()
+{
+
+}
+
+RecoveryIndex::~RecoveryIndex()
+{
+
+}
+
+void RecoveryIndex::addLocation(const RecoveryLocation &_loc)
+{
+  Node n;
+
+  toUnitVector(_loc.pos, n.v);
+  n.axis = 0;
+  n.loc = _loc;
+  nodes.push_back(n);
+}
+
+void RecoveryIndex::build()
+{
+  build(0, nodes.size());
+}
+
+size_t RecoveryIndex::size() const
+{
+  return nodes.size();
+}
+
+void RecoveryIndex::build(size_t _begin, size_t _end)
+{
+  /**
+   * The tree is implicit: the node for the range [_begin, _end) is stored at
+   * the midpoint, the left subtree is [_begin, mid), and the right subtree is
+   * (mid, _end). Split on the axis with the largest spread.
+   */
+  double lo[3] = {DBL_MAX, DBL_MAX, DBL_MAX}, hi[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+  size_t i, mid;
+  int a, axis = 0;
+
+  if (_end - _begin < 2)
+    return;
+
+  for (i = _begin; i < _end; ++i)
+  {
+    for (a = 0; a < 3; ++a)
+    {
+      lo[a] = min(lo[a], nodes[i].v[a]);
+      hi[a] = max(hi[a], nodes[i].v[a]);
+    }
+  }
+
+  for (a = 1; a < 3; ++a)
+  {
+    if (hi[a] - lo[a] > hi[axis] - lo[axis])
+      axis = a;
+  }
+
+  mid = _begin + (_end - _begin) / 2;
+  nth_element(nodes.begin() + _begin,
+              nodes.begin() + mid,
+              nodes.begin() + _end,
+              [axis](const Node &_a, const Node &_b) { return _a.v[axis] < _b.v[axis]; });
+  nodes[mid].axis = axis;
+
+  build(_begin, mid);
+  build(mid + 1, _end);
+}
+
+bool RecoveryIndex::getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc) const
+{
+  RecoveryQuery q(_ppos, _hdg, _maxDistance);
+  double best = q.maxChord2;
+  const Node *node = nullptr;
+
+  _loc.id = -1;
+
+  if (nodes.empty())
+    return false;
+
+  search(0, nodes.size(), q, best, node);
+
+  if (node == nullptr)
+    return false;
+
+  _loc = node->loc;
+
+  return true;
+}
+
+void RecoveryIndex::search(size_t _begin, size_t _end, const RecoveryQuery &_q, double &_best, const Node *&_node) const
+{
+  size_t mid;
+  const Node *n;
+  double d2, diff;
+
+  if (_begin >= _end)
+    return;
+
+  mid = _begin + (_end - _begin) / 2;
+  n = &nodes[mid];
+  d2 = _q.chord2(n->v);
+
+  if (d2 <= _best && _q.inSector(n->v))
+  {
+    _best = d2;
+    _node = n;
+  }
+
+  if (_end - _begin < 2)
+    return;
+
+  diff = _q.p[n->axis] - n->v[n->axis];
+
+  if (diff < 0.0)
+  {
+    search(_begin, mid, _q, _best, _node);
+
+    if (diff * diff <= _best)
+      search(mid + 1, _end, _q, _best, _node);
+  }
+  else
+  {
+    search(mid + 1, _end, _q, _best, _node);
+
+    if (diff * diff <= _best)
+      search(_begin, mid, _q, _best, _node);
+  }
+}
+
+void RecoveryIndex::getLocationsWithin(const Loc &_ppos, double _distance, std::vector<RecoveryLocation> &_locs) const
+{
+  RecoveryQuery q(_ppos, 0.0, _distance);
+  collect(0, nodes.size(), q, _locs);
+}
+
+void RecoveryIndex::collect(size_t _begin, size_t _end, const RecoveryQuery &_q, std::vector<RecoveryLocation> &_locs) const
+{
+  size_t mid;
+  const Node *n;
+  double diff;
+
+  if (_begin >= _end)
+    return;
+
+  mid = _begin + (_end - _begin) / 2;
+  n = &nodes[mid];
+
+  if (_q.chord2(n->v) <= _q.maxChord2)
+    _locs.push_back(n->loc);
+
+  if (_end - _begin < 2)
+    return;
+
+  diff = _q.p[n->axis] - n->v[n->axis];
+
+  if (diff < 0.0 || diff * diff <= _q.maxChord2)
+    collect(_begin, mid, _q, _locs);
+
+  if (diff >= 0.0 || diff * diff <= _q.maxChord2)
+    collect(mid + 1, _end, _q, _locs);
+}
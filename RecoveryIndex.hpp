@@ -0,0 +1,55 @@
+#ifndef RecoveryIndex_hpp
+#define RecoveryIndex_hpp
+
+#include <vector>
+#include "GISDatabase.hpp"
+#include "RecoveryQuery.hpp"
+
+/**
+ * The RecoveryIndex class is an in-memory k-d tree of recovery locations. The
+ * locations are stored as unit vectors on the sphere so that great-circle
+ * distance is monotonic with straight-line (chord) distance, which lets the
+ * tree prune without any trigonometry.
+ *
+ * Add all of the locations, then call build() once. The index is read-only
+ * after it has been built.
+ */
+class RecoveryIndex
+{
+private:
+  struct Node
+  {
+    double v[3];
+    int axis;
+    RecoveryLocation loc;
+  };
+
+public:
+  RecoveryIndex();
+
+public:
+  ~RecoveryIndex();
+
+public:
+  void addLocation(const RecoveryLocation &_loc);
+
+  void build();
+
+  size_t size() const;
+
+  bool getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc) const;
+
+  void getLocationsWithin(const Loc &_ppos, double _distance, std::vector<RecoveryLocation> &_locs) const;
+
+private:
+  void build(size_t _begin, size_t _end);
+
+  void search(size_t _begin, size_t _end, const RecoveryQuery &_q, double &_best, const Node *&_node) const;
+
+  void collect(size_t _begin, size_t _end, const RecoveryQuery &_q, std::vector<RecoveryLocation> &_locs) const;
+
+private:
+  std::vector<Node> nodes;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RecoveryQuery_hpp
+#define RecoveryQuery_hpp
+
+#include "Utilities.hpp"
+
+/**
+ * RecoveryQuery holds the precomputed geometry for a recovery location search:
+ * the present position as a unit vector, the ground track as a unit vector in
+ * the local tangent plane, and the search radius as a squared chord length.
+ * Locations are only acceptable if they lie within the radius and within
+ * +/- 45 degrees of the ground track.
+ */
+struct RecoveryQuery
+{
+  double p[3];
+  double track[3];
+  double maxChord2;
+  double minSectorCos;
+
+  RecoveryQuery(const Loc &_ppos, double _hdg, double _maxDistance)
+  {
+    double north[3], east[3], lat, lon, h, theta;
+
+    lat = degToRad(_ppos.lat);
+    lon = degToRad(_ppos.lon);
+    h = degToRad(_hdg);
+    toUnitVector(_ppos, p);
+
+    north[0] = -sin(lat) * cos(lon);
+    north[1] = -sin(lat) * sin(lon);
+    north[2] = cos(lat);
+    east[0] = -sin(lon);
+    east[1] = cos(lon);
+    east[2] = 0.0;
+
+    track[0] = north[0] * cos(h) + east[0] * sin(h);
+    track[1] = north[1] * cos(h) + east[1] * sin(h);
+    track[2] = north[2] * cos(h) + east[2] * sin(h);
+
+    theta = std::min(std::max(_maxDistance, 0.0) / earthRadius, M_PI);
+    maxChord2 = 2.0 - 2.0 * cos(theta);
+    minSectorCos = cos(degToRad(45.0));
+  }
+
+  double chord2(const double _v[3]) const
+  {
+    double d0 = _v[0] - p[0], d1 = _v[1] - p[1], d2 = _v[2] - p[2];
+    return d0 * d0 + d1 * d1 + d2 * d2;
+  }
+
+  bool inSector(const double _v[3]) const
+  {
+    /**
+     * The tangent-plane component of the direction to the location has length
+     * sqrt(1 - c^2) where c is the cosine of the angular distance. The cosine
+     * of the angle off the track is the track component over that length.
+     */
+    double c = _v[0] * p[0] + _v[1] * p[1] + _v[2] * p[2];
+    double t = _v[0] * track[0] + _v[1] * track[1] + _v[2] * track[2];
+    double s = sqrt(std::max(1.0 - c * c, 0.0));
+
+    return (s == 0.0 || (t > 0.0 && t >= minSectorCos * s));
+  }
+};
+
+#endif
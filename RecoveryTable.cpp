@@ -0,0 +1,269 @@
+#include <sqlite3.h>
+#include <cstring>
+#include "RecoveryTable.hpp"
+#include "RecoveryQuery.hpp"
+
+using namespace std;
+
+/**
+ * The rtree stores 32-bit floats, rounded outward. Pad the query box by a
+ * little more than that rounding so that no point on its edge is missed.
+ */
+static const double boxPad = 1.0e-4;
+
+static const char *boxQuery =
+  "SELECT r.pkid, r.ident, r.elev, r.lat, r.lon "
+  "FROM RecoveryRTree t JOIN Recovery r ON r.pkid = t.id "
+  "WHERE t.maxLat >= ?1 AND t.minLat <= ?2 AND t.maxLon >= ?3 AND t.minLon <= ?4";
+
+static void readRecoveryLocation(sqlite3_stmt *_stmt, RecoveryLocation &_loc)
+{
+  const unsigned char *ident = sqlite3_column_text(_stmt, 1);
+
+  _loc.id = sqlite3_column_int64(_stmt, 0);
+  strncpy(_loc.ident, ident != nullptr ? (const char*)ident : "", 8);
+  _loc.ident[8] = 0;
+  _loc.elev = sqlite3_column_double(_stmt, 2);
+  _loc.pos.lat = sqlite3_column_double(_stmt, 3);
+  _loc.pos.lon = sqlite3_column_double(_stmt, 4);
+  toNVector(_loc.pos, _loc.nv);
+}
+
+RecoveryTable::RecoveryTable()
+: dbhandle(nullptr)
+{
+
+}
+
+RecoveryTable::~RecoveryTable()
+{
+  close();
+}
+
+bool RecoveryTable::open(const char *_path)
+{
+  sqlite3 *db = nullptr;
+  sqlite3_stmt *stmt = nullptr;
+  int ret;
+
+  close();
+
+  ret = sqlite3_open_v2(_path, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_FULLMUTEX, 0);
+
+  if (ret != SQLITE_OK)
+  {
+    if (db != nullptr)
+      sqlite3_close(db);
+
+    return false;
+  }
+
+  /**
+   * Preparing the box query also checks the schema. A SpatiaLite database has
+   * no RecoveryRTree table, so this fails and the caller can fall back.
+   */
+  ret = sqlite3_prepare_v2(db, boxQuery, -1, &stmt, nullptr);
+
+  if (ret != SQLITE_OK)
+  {
+    sqlite3_close(db);
+    return false;
+  }
+
+  sqlite3_finalize(stmt);
+  dbhandle = db;
+
+  return true;
+}
+
+void RecoveryTable::close()
+{
+  if (dbhandle != nullptr)
+    sqlite3_close((sqlite3*)dbhandle);
+
+  dbhandle = nullptr;
+}
+
+bool RecoveryTable::isOpen() const
+{
+  return (dbhandle != nullptr);
+}
+
+bool RecoveryTable::getAllLocations(vector<RecoveryLocation> &_locs)
+{
+  RecoveryLocation loc;
+  sqlite3_stmt *stmt;
+  int ret;
+
+  if (!isOpen())
+    return false;
+
+  ret = sqlite3_prepare_v2(
+   (sqlite3*)dbhandle,
+   "SELECT pkid, ident, elev, lat, lon FROM Recovery",
+   -1,
+   &stmt,
+   nullptr);
+
+  if (ret != SQLITE_OK)
+    return false;
+
+  while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+  {
+    readRecoveryLocation(stmt, loc);
+    _locs.push_back(loc);
+  }
+
+  sqlite3_finalize(stmt);
+
+  return (ret == SQLITE_DONE);
+}
+
+bool RecoveryTable::getLowestElevation(double &_elev)
+{
+  sqlite3_stmt *stmt;
+  int ret;
+
+  if (!isOpen())
+    return false;
+
+  ret = sqlite3_prepare_v2(
+   (sqlite3*)dbhandle,
+   "SELECT MIN(elev) FROM Recovery",
+   -1,
+   &stmt,
+   nullptr);
+
+  if (ret != SQLITE_OK)
+    return false;
+
+  // MIN() of an empty table is NULL.
+  ret = sqlite3_step(stmt);
+
+  if (ret == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+    _elev = sqlite3_column_double(stmt, 0);
+
+  sqlite3_finalize(stmt);
+
+  return (ret == SQLITE_ROW);
+}
+
+void RecoveryTable::queryBox(void *_stmt, double _minLat, double _maxLat, double _minLon, double _maxLon, vector<RecoveryLocation> &_locs)
+{
+  sqlite3_stmt *stmt = (sqlite3_stmt*)_stmt;
+  RecoveryLocation loc;
+
+  sqlite3_reset(stmt);
+  sqlite3_bind_double(stmt, 1, _minLat - boxPad);
+  sqlite3_bind_double(stmt, 2, _maxLat + boxPad);
+  sqlite3_bind_double(stmt, 3, _minLon - boxPad);
+  sqlite3_bind_double(stmt, 4, _maxLon + boxPad);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    readRecoveryLocation(stmt, loc);
+    _locs.push_back(loc);
+  }
+
+  sqlite3_reset(stmt);
+}
+
+void RecoveryTable::getCandidates(const Loc &_ppos, double _distance, vector<RecoveryLocation> &_locs)
+{
+  double theta, x, dLon, minLat, maxLat, minLon, maxLon;
+  sqlite3_stmt *stmt;
+
+  /**
+   * Prepare the statement per search rather than sharing one, so that any
+   * number of threads can search the same table at once.
+   */
+  if (sqlite3_prepare_v2((sqlite3*)dbhandle, boxQuery, -1, &stmt, nullptr) != SQLITE_OK)
+    return;
+
+  /**
+   * Find the lat/lon box covering the search radius. If the radius covers a
+   * pole, search every longitude. If the box crosses the antimeridian, split
+   * it in two.
+   */
+  theta = radToDeg(min(max(_distance, 0.0) / earthRadius, M_PI));
+  minLat = _ppos.lat - theta;
+  maxLat = _ppos.lat + theta;
+
+  x = sin(degToRad(theta)) / cos(degToRad(_ppos.lat));
+
+  if (minLat <= -90.0 || maxLat >= 90.0)
+    queryBox(stmt, max(minLat, -90.0), min(maxLat, 90.0), -180.0, 180.0, _locs);
+  else if (x >= 1.0)
+    queryBox(stmt, minLat, maxLat, -180.0, 180.0, _locs);
+  else
+  {
+    dLon = radToDeg(asin(x));
+    minLon = _ppos.lon - dLon;
+    maxLon = _ppos.lon + dLon;
+
+    if (minLon < -180.0)
+    {
+      queryBox(stmt, minLat, maxLat, -180.0, maxLon, _locs);
+      queryBox(stmt, minLat, maxLat, minLon + 360.0, 180.0, _locs);
+    }
+    else if (maxLon > 180.0)
+    {
+      queryBox(stmt, minLat, maxLat, minLon, 180.0, _locs);
+      queryBox(stmt, minLat, maxLat, -180.0, maxLon - 360.0, _locs);
+    }
+    else
+      queryBox(stmt, minLat, maxLat, minLon, maxLon, _locs);
+  }
+
+  sqlite3_finalize(stmt);
+}
+
+bool RecoveryTable::getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc)
+{
+  RecoveryQuery q(_ppos, _hdg, _maxDistance);
+  vector<RecoveryLocation> locs;
+  double best = q.maxChord2, d2, v[3];
+  size_t i;
+
+  _loc.id = -1;
+
+  if (!isOpen())
+    return false;
+
+  getCandidates(_ppos, _maxDistance, locs);
+
+  for (i = 0; i < locs.size(); ++i)
+  {
+    toUnitVector(locs[i].pos, v);
+    d2 = q.chord2(v);
+
+    if (d2 <= best && q.inSector(v))
+    {
+      best = d2;
+      _loc = locs[i];
+    }
+  }
+
+  return (_loc.id >= 0);
+}
+
+void RecoveryTable::getLocationsWithin(const Loc &_ppos, double _distance, vector<RecoveryLocation> &_locs)
+{
+  RecoveryQuery q(_ppos, 0.0, _distance);
+  vector<RecoveryLocation> locs;
+  double v[3];
+  size_t i;
+
+  if (!isOpen())
+    return;
+
+  getCandidates(_ppos, _distance, locs);
+
+  for (i = 0; i < locs.size(); ++i)
+  {
+    toUnitVector(locs[i].pos, v);
+
+    if (q.chord2(v) <= q.maxChord2)
+      _locs.push_back(locs[i]);
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef RecoveryTable_hpp
+#define RecoveryTable_hpp
+
+#include <cstddef>
+#include <vector>
+#include "GISDatabase.hpp"
+
+/**
+ * R*Tree recovery database schema written by rdbtool --format rtree.
+ *
+ * Locations are plain rows with lat/lon columns in degrees. A companion
+ * SQLite rtree virtual table holds a point bounding box for each row, keyed
+ * by the row's pkid. No SpatiaLite functions or geometry blobs are involved.
+ */
+
+#define RECOVERY_TABLE_SCHEMA \
+  "CREATE TABLE Recovery( " \
+  " pkid INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, " \
+  " ident TEXT NOT NULL, " \
+  " elev DOUBLE DEFAULT 0, " \
+  " lat DOUBLE NOT NULL, " \
+  " lon DOUBLE NOT NULL); " \
+  "CREATE VIRTUAL TABLE RecoveryRTree USING rtree(id, minLat, maxLat, minLon, maxLon);"
+
+/**
+ * The RecoveryTable class searches an R*Tree recovery database. The rtree
+ * only narrows the search to a lat/lon box around the query; the great-circle
+ * distance and sector tests are done here, exactly as RecoveryFile and
+ * RecoveryIndex do them.
+ */
+class RecoveryTable
+{
+public:
+  RecoveryTable();
+
+public:
+  ~RecoveryTable();
+
+public:
+  bool open(const char *_path);
+
+  void close();
+
+  bool isOpen() const;
+
+  bool getAllLocations(std::vector<RecoveryLocation> &_locs);
+
+  bool getLowestElevation(double &_elev);
+
+  bool getRecoveryLocation(const Loc &_ppos, double _hdg, double _maxDistance, RecoveryLocation &_loc);
+
+  void getLocationsWithin(const Loc &_ppos, double _distance, std::vector<RecoveryLocation> &_locs);
+
+private:
+  void getCandidates(const Loc &_ppos, double _distance, std::vector<RecoveryLocation> &_locs);
+
+  void queryBox(void *_stmt, double _minLat, double _maxLat, double _minLon, double _maxLon, std::vector<RecoveryLocation> &_locs);
+
+private:
+  void *dbhandle;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include <stdexcept>
+#include <cstring>
+#include "RecoveryWorker.hpp"
+
+void* RecoveryWorker::threadProc(void *_ptr)
+{
+  RecoveryWorker *w = static_cast<RecoveryWorker*>(_ptr);
+  RecoveryResult r;
+  unsigned int gen, rev;
+
+  pthread_mutex_lock(&w->lock);
+
+  while (true)
+  {
+    while (!w->pending && __sync_bool_compare_and_swap(&w->cancel, 0, 0))
+      pthread_cond_wait(&w->wake, &w->lock);
+
+    if (!__sync_bool_compare_and_swap(&w->cancel, 0, 0))
+      break;
+
+    r.req = w->request;
+    gen = w->pendingGeneration;
+    w->pending = false;
+
+    /**
+     * Do not hold the lock while querying. The control loop is free to submit
+     * a newer request in the meantime; it simply replaces the pending one.
+     */
+    pthread_mutex_unlock(&w->lock);
+    rev = w->db->getRevision();
+    w->query(r);
+    pthread_mutex_lock(&w->lock);
+
+    w->memo = r;
+    w->memoRevision = rev;
+    w->memoValid = true;
+
+    // Drop the answer if the caller has reset since the request was made.
+    if (gen == w->generation)
+    {
+      w->result = r;
+      w->complete = true;
+    }
+  }
+
+  pthread_mutex_unlock(&w->lock);
+  pthread_exit(NULL);
+}
+
+RecoveryWorker::RecoveryWorker(GISDatabase *_db, RecoveryCostFunction _cost, void *_costArg)
+: db(_db),
+  cost(_cost),
+  costArg(_costArg),
+  cancel(0),
+  running(false),
+  pending(false),
+  complete(false),
+  memoValid(false),
+  memoRevision(0),
+  generation(0),
+  pendingGeneration(0),
+  workerThread(0),
+  lock(PTHREAD_MUTEX_INITIALIZER),
+  wake(PTHREAD_COND_INITIALIZER)
+{
+  if (db == nullptr)
+    throw std::invalid_argument("_db");
+
+  memset(&request, 0, sizeof(request));
+  memset(&result, 0, sizeof(result));
+  memset(&memo, 0, sizeof(memo));
+}
+
+RecoveryWorker::~RecoveryWorker()
+{
+  stop();
+}
+
+bool RecoveryWorker::start()
+{
+  stop();
+
+  if (pthread_create(&workerThread, NULL, threadProc, this) != 0)
+  {
+    workerThread = 0;
+    return false;
+  }
+
+  running = true;
+
+  return true;
+}
+
+void RecoveryWorker::stop()
+{
+  if (!running)
+    return;
+
+  pthread_mutex_lock(&lock);
+  __sync_bool_compare_and_swap(&cancel, 0, 1);
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&lock);
+
+  pthread_join(workerThread, NULL);
+  workerThread = 0;
+  running = false;
+  cancel = 0;
+}
+
+void RecoveryWorker::submit(const Loc &_ppos, double _alt, double _hdg, double _maxDistance, double _elev)
+{
+  RecoveryResult r;
+
+  r.req.ppos = _ppos;
+  r.req.alt = _alt;
+  r.req.hdg = _hdg;
+  r.req.maxDistance = _maxDistance;
+  r.req.elev = _elev;
+
+  if (!running)
+  {
+    // No thread; answer synchronously so that callers still make progress.
+    if (memoIsValid(_ppos, _hdg, _maxDistance))
+      r = memo;
+    else
+    {
+      memoRevision = db->getRevision();
+      query(r);
+      memo = r;
+      memoValid = true;
+    }
+
+    result = r;
+    result.req.ppos = _ppos;
+    result.req.alt = _alt;
+    result.req.hdg = _hdg;
+    result.req.maxDistance = _maxDistance;
+    result.req.elev = _elev;
+    complete = true;
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+
+  if (memoIsValid(_ppos, _hdg, _maxDistance))
+  {
+    /**
+     * The last answer still holds. Drop any pending request; it would only
+     * produce the same answer.
+     */
+    result = memo;
+    result.req = r.req;
+    complete = true;
+    pending = false;
+    pthread_mutex_unlock(&lock);
+    return;
+  }
+
+  request = r.req;
+  pendingGeneration = generation;
+  pending = true;
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&lock);
+}
+
+bool RecoveryWorker::poll(RecoveryResult &_result)
+{
+  bool ret;
+
+  pthread_mutex_lock(&lock);
+
+  if ((ret = complete))
+  {
+    _result = result;
+    complete = false;
+  }
+
+  pthread_mutex_unlock(&lock);
+
+  return ret;
+}
+
+bool RecoveryWorker::memoIsValid(const Loc &_ppos, double _hdg, double _maxDistance) const
+{
+  // A reloaded database invalidates every region certified before the reload.
+  return (memoValid &&
+          memoRevision == db->getRevision() &&
+          memo.region.contains(_ppos, _hdg, _maxDistance));
+}
+
+void RecoveryWorker::query(RecoveryResult &_r)
+{
+  std::vector<RecoveryCandidate> cands;
+  size_t i;
+
+  // One neighbourhood scan for both the answer and the alternates.
+  _r.found = db->getRecoveryLocation(
+    _r.req.ppos,
+    _r.req.alt,
+    _r.req.hdg,
+    _r.req.maxDistance,
+    _r.req.elev,
+    _r.loc,
+    _r.region,
+    MAX_RECOVERY_CANDIDATES,
+    cands,
+    cost,
+    costArg);
+
+  _r.candidateCount = cands.size();
+
+  for (i = 0; i < _r.candidateCount; ++i)
+    _r.candidates[i] = cands[i];
+}
+
+void RecoveryWorker::reset()
+{
+  pthread_mutex_lock(&lock);
+  ++generation;
+  pending = false;
+  complete = false;
+  pthread_mutex_unlock(&lock);
+}
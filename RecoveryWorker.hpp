@@ -0,0 +1,96 @@
+#ifndef RecoveryWorker_hpp
+#define RecoveryWorker_hpp
+
+#include <pthread.h>
+#include "GISDatabase.hpp"
+
+#define MAX_RECOVERY_CANDIDATES 5
+
+struct RecoveryRequest
+{
+  Loc ppos;
+  double alt;
+  double hdg;
+  double maxDistance;
+  double elev;      // the elevation maxDistance is projected down to
+};
+
+struct RecoveryResult
+{
+  RecoveryRequest req;
+  bool found;
+  RecoveryLocation loc;
+  RecoveryRegion region;
+  size_t candidateCount;
+  RecoveryCandidate candidates[MAX_RECOVERY_CANDIDATES];
+};
+
+/**
+ * RecoveryWorker runs GISDatabase queries on a background thread so that the
+ * caller never blocks on the database. submit() posts a request and returns
+ * immediately; poll() picks up the newest completed answer, if any. Only one
+ * request is ever pending: submitting again before the worker gets to it
+ * replaces the stale request.
+ *
+ * Each answer comes with the region in which it cannot change. While requests
+ * stay inside the region of the last answer, submit() answers them directly
+ * without waking the worker. A database reload discards the region.
+ *
+ * Each answer also carries up to MAX_RECOVERY_CANDIDATES alternates ranked by
+ * the worker's cost function, evaluated at the position of the request. Each
+ * is in reach given its own elevation, and all come from the same scan as the
+ * answer. The alternates are not covered by the region; callers must re-check
+ * them.
+ *
+ * The worker does not own the database. Queries take no locks and a reload
+ * swaps the data atomically, so other threads may query the database while
+ * the worker is running. The database MUST outlive the worker, and its
+ * terrain MUST NOT be changed with setTerrain() while the worker is running.
+ */
+class RecoveryWorker
+{
+private:
+  static void* threadProc(void *_ptr);
+
+  bool memoIsValid(const Loc &_ppos, double _hdg, double _maxDistance) const;
+
+  void query(RecoveryResult &_r);
+
+public:
+  RecoveryWorker(GISDatabase *_db, RecoveryCostFunction _cost = recoveryDistanceCost, void *_costArg = nullptr);
+
+public:
+  ~RecoveryWorker();
+
+public:
+  bool start();
+
+  void stop();
+
+  void submit(const Loc &_ppos, double _alt, double _hdg, double _maxDistance, double _elev);
+
+  bool poll(RecoveryResult &_result);
+
+  void reset();
+
+private:
+  GISDatabase *db;
+  RecoveryCostFunction cost;
+  void *costArg;
+  long cancel;
+  bool running;
+  bool pending;
+  bool complete;
+  bool memoValid;
+  unsigned int memoRevision;
+  unsigned int generation;
+  unsigned int pendingGeneration;
+  RecoveryRequest request;
+  RecoveryResult result;
+  RecoveryResult memo;
+  pthread_t workerThread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef ResponseCurves_hpp
+#define ResponseCurves_hpp
+
+#include <cmath>
+#include <algorithm>
+
+/**
+ * The rudder loop's two response curves; see FlightDirector::refreshRudder().
+ *
+ *   rate of turn:  Rt = 1.0472941228^|dH| - 1        for |dH| in [0, 30] deg
+ *   rudder:        Ar = log10( |dR| + .33 ) + .48    for |dR| in [0, 3] deg/s
+ *
+ * By default both are read from tables with linear interpolation, which are
+ * built by the compiler from constexpr series for exp() and log(). Define
+ * EXACT_RESPONSE_CURVES to call pow() and log10() instead. Inputs are clamped
+ * to the domains above. Both forms are always available under their own names
+ * so they can be compared; bench_response_curves checks the largest
+ * difference over the whole domain against the bounds below.
+ */
+
+constexpr double rateOfTurnCurveMax = 30.0;  // deg of heading error
+constexpr double rudderCurveMax = 3.0;       // deg/s of rate-of-turn error
+
+/**
+ * Largest table error over each domain. Linear interpolation is off by at
+ * most h^2 / 8 times the largest second derivative over an interval of width
+ * h: 1.5e-5 deg/s for the rate-of-turn curve, and 6.8e-5 for the rudder
+ * curve, whose curvature is greatest at |dR| = 0.
+ */
+constexpr double rateOfTurnCurveBound = 2e-5;
+constexpr double rudderCurveBound = 1e-4;
+
+inline double exactRateOfTurnCurve(double _absHdgErr)
+{
+  return pow(1.0472941228, std::min(std::max(_absHdgErr, 0.0), rateOfTurnCurveMax)) - 1.0;
+}
+
+inline double exactRudderCurve(double _absRoTErr)
+{
+  return log10(std::min(std::max(_absRoTErr, 0.0), rudderCurveMax) + 0.33) + 0.48;
+}
+
+/**
+ * Constexpr building blocks. C++11 constexpr functions are a single return
+ * statement, so the series are written as recursions.
+ */
+namespace ResponseCurveDetail
+{
+
+constexpr unsigned int intervals = 256;
+
+// exp(_x) by its Taylor series; good to an ulp or two for |_x| < 2.
+constexpr double expSeries(double _x, double _term = 1.0, unsigned int _n = 0)
+{
+  return (_n > 40 ? 0.0 : _term + expSeries(_x, _term * _x / (_n + 1), _n + 1));
+}
+
+// log(_u) as 2 atanh((_u - 1) / (_u + 1)); good to an ulp or two for _u in
+// [0.25, 4].
+constexpr double atanhSeries(double _z, double _z2, double _power, unsigned int _n = 0)
+{
+  return (_n > 60 ? 0.0 : _power / (2 * _n + 1) + atanhSeries(_z, _z2, _power * _z2, _n + 1));
+}
+
+constexpr double logSeries(double _u)
+{
+  return 2.0 * atanhSeries((_u - 1.0) / (_u + 1.0),
+                           ((_u - 1.0) / (_u + 1.0)) * ((_u - 1.0) / (_u + 1.0)),
+                           (_u - 1.0) / (_u + 1.0));
+}
+
+constexpr double ln10 = 2.302585092994045684;
+
+constexpr double rateOfTurnAt(unsigned int _i)
+{
+  return expSeries(rateOfTurnCurveMax * _i / intervals * logSeries(1.0472941228)) - 1.0;
+}
+
+constexpr double rudderAt(unsigned int _i)
+{
+  return logSeries(rudderCurveMax * _i / intervals + 0.33) / ln10 + 0.48;
+}
+
+template <unsigned int... I>
+struct Indices
+{
+};
+
+template <unsigned int N, unsigned int... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template <unsigned int... I>
+struct MakeIndices<0, I...>
+{
+  typedef Indices<I...> type;
+};
+
+template <typename Seq>
+struct Tables;
+
+template <unsigned int... I>
+struct Tables<Indices<I...> >
+{
+  static constexpr double rateOfTurn[] = { rateOfTurnAt(I)... };
+  static constexpr double rudder[] = { rudderAt(I)... };
+};
+
+template <unsigned int... I>
+constexpr double Tables<Indices<I...> >::rateOfTurn[];
+
+template <unsigned int... I>
+constexpr double Tables<Indices<I...> >::rudder[];
+
+typedef Tables<MakeIndices<intervals + 1>::type> CurveTables;
+
+inline double interpolate(const double *_table, double _x, double _max)
+{
+  double t = (_x > 0.0 ? std::min(_x, _max) : 0.0) * (intervals / _max);
+  unsigned int i = std::min((unsigned int)t, intervals - 1);
+
+  return _table[i] + (_table[i + 1] - _table[i]) * (t - i);
+}
+
+}
+
+inline double tableRateOfTurnCurve(double _absHdgErr)
+{
+  return ResponseCurveDetail::interpolate(ResponseCurveDetail::CurveTables::rateOfTurn, _absHdgErr, rateOfTurnCurveMax);
+}
+
+inline double tableRudderCurve(double _absRoTErr)
+{
+  return ResponseCurveDetail::interpolate(ResponseCurveDetail::CurveTables::rudder, _absRoTErr, rudderCurveMax);
+}
+
+inline double rateOfTurnCurve(double _absHdgErr)
+{
+#ifdef EXACT_RESPONSE_CURVES
+  return exactRateOfTurnCurve(_absHdgErr);
+#else
+  return tableRateOfTurnCurve(_absHdgErr);
+#endif
+}
+
+inline double rudderCurve(double _absRoTErr)
+{
+#ifdef EXACT_RESPONSE_CURVES
+  return exactRudderCurve(_absRoTErr);
+#else
+  return tableRudderCurve(_absRoTErr);
+#endif
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef RingAverage_hpp
+#define RingAverage_hpp
+
+#include <cstring>
+
+/**
+ * Smallest power of two not less than _n.
+ */
+constexpr unsigned int ringCapacity(unsigned int _n, unsigned int _p = 1)
+{
+  return (_p >= _n ? _p : ringCapacity(_n, _p << 1));
+}
+
+/**
+ * RingAverage is a moving average over the last N samples of one or more
+ * channels, with the samples stored inline; nothing is allocated. The ring is
+ * rounded up to a power of two so the write index is masked rather than taken
+ * modulo the length, and samples are stored channel-minor so a multi-channel
+ * push is a short loop the compiler can vectorize, e.g. gyro x, y, and z in
+ * one call with Channels = 3.
+ *
+ * Until N samples have been pushed the average is over the samples pushed so
+ * far.
+ *
+ * The window sum is kept in two parts so that it cannot drift. `fresh' sums
+ * the samples pushed since the start of the current epoch of N pushes; `tail'
+ * is the exact sum of the window as it stood at the start of the epoch, less
+ * the samples that have left it since. Evicted samples always come from the
+ * previous epoch, so after N pushes the window is exactly the samples in
+ * `fresh'; it becomes the new `tail' and `fresh' starts over. The rounding
+ * from the subtractions is thrown away every N pushes instead of building up
+ * over the life of the buffer, and every push is still O(1).
+ */
+template <typename T, unsigned int N, unsigned int Channels = 1>
+class RingAverage
+{
+  static_assert(N > 0, "RingAverage needs at least one sample");
+  static_assert(Channels > 0, "RingAverage needs at least one channel");
+
+public:
+  typedef T Sample;
+
+public:
+  static const unsigned int length = N;
+  static const unsigned int channels = Channels;
+
+public:
+  RingAverage()
+  {
+    reset();
+  }
+
+public:
+  /**
+   * Single-channel push; returns the new average.
+   */
+  T pushSample(T _sample)
+  {
+    static_assert(Channels == 1, "use pushSample(const T *, T *) for multiple channels");
+
+    pushSample(&_sample, &_sample);
+    return _sample;
+  }
+
+  /**
+   * Pushes one sample for every channel from _sample and, if _average is not
+   * null, stores the new averages there. _sample and _average may alias.
+   */
+  void pushSample(const T *_sample, T *_average = nullptr)
+  {
+    T *in = buffer[i & mask];
+    unsigned int c;
+
+    if (samples == N)
+    {
+      const T *out = buffer[(i - N) & mask];
+
+      for (c = 0; c < Channels; ++c)
+        tail[c] -= out[c];
+    }
+    else
+      ++samples;
+
+    for (c = 0; c < Channels; ++c)
+    {
+      in[c] = _sample[c];
+      fresh[c] += in[c];
+    }
+
+    ++i;
+
+    if (++epoch == N)
+    {
+      for (c = 0; c < Channels; ++c)
+      {
+        tail[c] = fresh[c];
+        fresh[c] = static_cast<T>(0);
+      }
+
+      epoch = 0;
+    }
+
+    if (_average != nullptr)
+      average(_average);
+  }
+
+  /**
+   * Single-channel average.
+   */
+  T average() const
+  {
+    static_assert(Channels == 1, "use average(T *) for multiple channels");
+
+    return (samples > 0 ? (tail[0] + fresh[0]) / static_cast<T>(samples) : static_cast<T>(0));
+  }
+
+  void average(T *_average) const
+  {
+    unsigned int c;
+
+    if (samples == 0)
+    {
+      for (c = 0; c < Channels; ++c)
+        _average[c] = static_cast<T>(0);
+      return;
+    }
+
+    for (c = 0; c < Channels; ++c)
+      _average[c] = (tail[c] + fresh[c]) / static_cast<T>(samples);
+  }
+
+  /**
+   * Same as average(), so a RingAverage can stand in for any of the filters
+   * in Filters.hpp.
+   */
+  T value() const
+  {
+    return average();
+  }
+
+  /**
+   * Number of samples in the average, at most N.
+   */
+  unsigned int count() const
+  {
+    return samples;
+  }
+
+  void reset()
+  {
+    i = samples = epoch = 0;
+    memset(tail, 0, sizeof(tail));
+    memset(fresh, 0, sizeof(fresh));
+    memset(buffer, 0, sizeof(buffer));
+  }
+
+private:
+  static const unsigned int capacity = ringCapacity(N);
+  static const unsigned int mask = capacity - 1;
+
+private:
+  T buffer[capacity][Channels];
+  T tail[Channels];
+  T fresh[Channels];
+  unsigned int i, samples, epoch;
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef Statistics_hpp
+#define Statistics_hpp
+
+#include <cmath>
+#include "RingAverage.hpp"
+
+/**
+ * Streaming statistics for watching sensor health. Everything here is O(1)
+ * per sample, amortized for SlidingExtrema, and keeps no raw history beyond
+ * the sliding window, so it can run on the 800 Hz IMU stream.
+ */
+
+/**
+ * Mean and variance since the last reset by Welford's method, which does not
+ * lose precision the way summing squares does.
+ */
+template <typename T>
+class RunningStats
+{
+public:
+  RunningStats()
+  {
+    reset();
+  }
+
+public:
+  void pushSample(T _sample)
+  {
+    T d = _sample - m;
+
+    ++n;
+    m += d / static_cast<T>(n);
+    m2 += d * (_sample - m);
+  }
+
+  unsigned long count() const
+  {
+    return n;
+  }
+
+  T mean() const
+  {
+    return m;
+  }
+
+  /**
+   * Sample variance; 0 until there are two samples.
+   */
+  T variance() const
+  {
+    return (n > 1 ? m2 / static_cast<T>(n - 1) : static_cast<T>(0));
+  }
+
+  T stddev() const
+  {
+    return sqrt(variance());
+  }
+
+  void reset()
+  {
+    n = 0;
+    m = m2 = static_cast<T>(0);
+  }
+
+private:
+  unsigned long n;
+  T m, m2;
+};
+
+/**
+ * Minimum and maximum of the last N samples, each kept in a monotonic deque:
+ * a push drops the samples it dominates from the back and expired samples from
+ * the front, so each sample is added and removed once. The deques are rings
+ * of inline storage like RingAverage's and never hold more than N samples.
+ */
+template <typename T, unsigned int N>
+class SlidingExtrema
+{
+  static_assert(N > 0, "SlidingExtrema needs at least one sample");
+
+public:
+  SlidingExtrema()
+  {
+    reset();
+  }
+
+public:
+  void pushSample(T _sample)
+  {
+    // Indices wrap with unsigned arithmetic; only differences are compared.
+    if (minHead != minTail && i - minIndex[minHead & mask] >= N)
+      ++minHead;
+    if (maxHead != maxTail && i - maxIndex[maxHead & mask] >= N)
+      ++maxHead;
+
+    while (minTail != minHead && !(minValue[(minTail - 1) & mask] < _sample))
+      --minTail;
+    while (maxTail != maxHead && !(_sample < maxValue[(maxTail - 1) & mask]))
+      --maxTail;
+
+    minValue[minTail & mask] = _sample;
+    minIndex[minTail++ & mask] = i;
+    maxValue[maxTail & mask] = _sample;
+    maxIndex[maxTail++ & mask] = i;
+    ++i;
+  }
+
+  /**
+   * The extremes of an empty window are 0.
+   */
+  T min() const
+  {
+    return (minHead != minTail ? minValue[minHead & mask] : static_cast<T>(0));
+  }
+
+  T max() const
+  {
+    return (maxHead != maxTail ? maxValue[maxHead & mask] : static_cast<T>(0));
+  }
+
+  void reset()
+  {
+    i = minHead = minTail = maxHead = maxTail = 0;
+  }
+
+private:
+  static const unsigned int capacity = ringCapacity(N);
+  static const unsigned int mask = capacity - 1;
+
+private:
+  T minValue[capacity];
+  T maxValue[capacity];
+  unsigned int minIndex[capacity];
+  unsigned int maxIndex[capacity];
+  unsigned int i, minHead, minTail, maxHead, maxTail;
+};
+
+/**
+ * Estimates one quantile of everything pushed since the last reset with the
+ * P-squared algorithm of Jain and Chlamtac: five markers track the minimum,
+ * the p/2, p, and (1 + p)/2 quantiles, and the maximum, and are nudged along
+ * a piecewise-parabolic fit as samples arrive. Until five samples have been
+ * pushed the estimate is read from the sorted samples.
+ */
+template <typename T>
+class P2Quantile
+{
+public:
+  P2Quantile(double _p = 0.5)
+  : p(_p)
+  {
+    reset();
+  }
+
+public:
+  void pushSample(T _sample)
+  {
+    int i, k;
+    double d;
+    T qp;
+
+    if (n < 5)
+    {
+      // Insertion sort into the markers until they are initialized.
+      for (i = n++; i > 0 && _sample < q[i - 1]; --i)
+        q[i] = q[i - 1];
+
+      q[i] = _sample;
+      return;
+    }
+
+    if (_sample < q[0])
+    {
+      q[0] = _sample;
+      k = 0;
+    }
+    else if (!(_sample < q[4]))
+    {
+      q[4] = _sample;
+      k = 3;
+    }
+    else
+    {
+      for (k = 0; !(_sample < q[k + 1]); ++k)
+        ;
+    }
+
+    ++n;
+
+    for (i = k + 1; i < 5; ++i)
+      ++pos[i];
+    for (i = 0; i < 5; ++i)
+      want[i] += step[i];
+
+    for (i = 1; i < 4; ++i)
+    {
+      d = want[i] - pos[i];
+
+      if ((d >= 1.0 && pos[i + 1] - pos[i] > 1) || (d <= -1.0 && pos[i - 1] - pos[i] < -1))
+      {
+        k = (d > 0.0 ? 1 : -1);
+        qp = parabolic(i, k);
+
+        if (q[i - 1] < qp && qp < q[i + 1])
+          q[i] = qp;
+        else
+          q[i] += k * (q[i + k] - q[i]) / static_cast<T>(pos[i + k] - pos[i]);
+
+        pos[i] += k;
+      }
+    }
+  }
+
+  unsigned long count() const
+  {
+    return n;
+  }
+
+  /**
+   * The quantile estimate; 0 before the first sample.
+   */
+  T value() const
+  {
+    if (n == 0)
+      return static_cast<T>(0);
+    if (n < 5)
+      return q[(int)(p * (n - 1) + 0.5)];
+
+    return q[2];
+  }
+
+  void reset()
+  {
+    int i;
+
+    n = 0;
+
+    for (i = 0; i < 5; ++i)
+    {
+      q[i] = static_cast<T>(0);
+      pos[i] = i;
+    }
+
+    want[0] = 0.0;
+    want[1] = 2.0 * p;
+    want[2] = 4.0 * p;
+    want[3] = 2.0 + 2.0 * p;
+    want[4] = 4.0;
+    step[0] = 0.0;
+    step[1] = p / 2.0;
+    step[2] = p;
+    step[3] = (1.0 + p) / 2.0;
+    step[4] = 1.0;
+  }
+
+private:
+  T parabolic(int _i, int _d) const
+  {
+    T d = static_cast<T>(_d);
+    T lo = static_cast<T>(pos[_i] - pos[_i - 1]), hi = static_cast<T>(pos[_i + 1] - pos[_i]);
+
+    return q[_i] + d / (lo + hi) * ((lo + d) * (q[_i + 1] - q[_i]) / hi + (hi - d) * (q[_i] - q[_i - 1]) / lo);
+  }
+
+private:
+  double p;
+  unsigned long n;
+  T q[5];         // marker heights
+  long pos[5];    // marker positions
+  double want[5]; // desired marker positions
+  double step[5]; // desired position increments
+};
+
+/**
+ * A snapshot of one channel's statistics, small enough to copy out under a
+ * lock at the sensor rate.
+ */
+struct StatsSummary
+{
+  unsigned long count;  // samples since the last reset
+  double mean;
+  double stddev;
+  double min;           // over the sliding window
+  double max;           // over the sliding window
+  double p05;
+  double median;
+  double p95;
+};
+
+/**
+ * All of the above for one channel: Welford mean and deviation and P-squared
+ * 5th, 50th, and 95th percentiles since the last reset, and the minimum and
+ * maximum over the last Window samples.
+ */
+template <unsigned int Window>
+class ChannelStats
+{
+public:
+  ChannelStats()
+  : p05(0.05),
+    median(0.5),
+    p95(0.95)
+  {
+
+  }
+
+public:
+  void pushSample(double _sample)
+  {
+    stats.pushSample(_sample);
+    extrema.pushSample(_sample);
+    p05.pushSample(_sample);
+    median.pushSample(_sample);
+    p95.pushSample(_sample);
+  }
+
+  void summarize(StatsSummary &_summary) const
+  {
+    _summary.count = stats.count();
+    _summary.mean = stats.mean();
+    _summary.stddev = stats.stddev();
+    _summary.min = extrema.min();
+    _summary.max = extrema.max();
+    _summary.p05 = p05.value();
+    _summary.median = median.value();
+    _summary.p95 = p95.value();
+  }
+
+  void reset()
+  {
+    stats.reset();
+    extrema.reset();
+    p05.reset();
+    median.reset();
+    p95.reset();
+  }
+
+private:
+  RunningStats<double> stats;
+  SlidingExtrema<double, Window> extrema;
+  P2Quantile<double> p05;
+  P2Quantile<double> median;
+  P2Quantile<double> p95;
+};
+
+#endif
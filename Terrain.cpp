@@ -0,0 +1,299 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "Terrain.hpp"
+
+using namespace std;
+
+float terrainMinClearance(const float *_elev, size_t _count, float _alt, float _step)
+{
+  float m = FLT_MAX;
+  size_t i = 0;
+
+  /**
+   * Carry the sample indices in a vector and compute the line altitude from
+   * them rather than stepping the altitude itself, so that every lane rounds
+   * exactly as the scalar tail does. Indices are exact in a float up to 2^24.
+   */
+#if defined(__AVX__)
+  float lanes[8];
+  __m256 vm = _mm256_set1_ps(FLT_MAX);
+  __m256 vi = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+  __m256 va = _mm256_set1_ps(_alt), vs = _mm256_set1_ps(_step), vw = _mm256_set1_ps(8);
+
+  for (; i + 8 <= _count; i += 8)
+  {
+    vm = _mm256_min_ps(vm, _mm256_sub_ps(_mm256_add_ps(va, _mm256_mul_ps(vi, vs)), _mm256_loadu_ps(_elev + i)));
+    vi = _mm256_add_ps(vi, vw);
+  }
+
+  _mm256_storeu_ps(lanes, vm);
+
+  for (int j = 0; j < 8; ++j)
+    m = min(m, lanes[j]);
+#elif defined(__SSE2__)
+  float lanes[4];
+  __m128 vm = _mm_set1_ps(FLT_MAX);
+  __m128 vi = _mm_set_ps(3, 2, 1, 0);
+  __m128 va = _mm_set1_ps(_alt), vs = _mm_set1_ps(_step), vw = _mm_set1_ps(4);
+
+  for (; i + 4 <= _count; i += 4)
+  {
+    vm = _mm_min_ps(vm, _mm_sub_ps(_mm_add_ps(va, _mm_mul_ps(vi, vs)), _mm_loadu_ps(_elev + i)));
+    vi = _mm_add_ps(vi, vw);
+  }
+
+  _mm_storeu_ps(lanes, vm);
+
+  for (int j = 0; j < 4; ++j)
+    m = min(m, lanes[j]);
+#elif defined(__ARM_NEON)
+  static const float idx[4] = { 0, 1, 2, 3 };
+  float32x4_t vm = vdupq_n_f32(FLT_MAX);
+  float32x4_t vi = vld1q_f32(idx);
+  float32x4_t va = vdupq_n_f32(_alt), vw = vdupq_n_f32(4);
+  float32x2_t vh;
+
+  for (; i + 4 <= _count; i += 4)
+  {
+    vm = vminq_f32(vm, vsubq_f32(vmlaq_n_f32(va, vi, _step), vld1q_f32(_elev + i)));
+    vi = vaddq_f32(vi, vw);
+  }
+
+  vh = vpmin_f32(vget_low_f32(vm), vget_high_f32(vm));
+  vh = vpmin_f32(vh, vh);
+  m = vget_lane_f32(vh, 0);
+#endif
+
+  for (; i < _count; ++i)
+    m = min(m, _alt + i * _step - _elev[i]);
+
+  return m;
+}
+
+void Terrain::tileName(int _lat, int _lon, char *_name, size_t _len)
+{
+  snprintf(_name, _len, "%c%02d%c%03d.dem",
+    _lat < 0 ? 'S' : 'N', abs(_lat),
+    _lon < 0 ? 'W' : 'E', abs(_lon));
+}
+
+Terrain::Terrain(const char *_dir, size_t _cacheTiles)
+: dir(_dir != nullptr ? _dir : ""),
+  useCount(0),
+  lock(PTHREAD_MUTEX_INITIALIZER)
+{
+  Tile t;
+
+  memset(&t, 0, sizeof(t));
+  tiles.resize(max(_cacheTiles, (size_t)1), t);
+  profile.resize(TERRAIN_PROFILE_SAMPLES);
+
+  if (!dir.empty() && dir.back() != '/')
+    dir.push_back('/');
+}
+
+Terrain::~Terrain()
+{
+  for (size_t i = 0; i < tiles.size(); ++i)
+    unloadTile(tiles[i]);
+}
+
+bool Terrain::getElevation(const Loc &_pos, double &_elev)
+{
+  bool ret;
+
+  pthread_mutex_lock(&lock);
+  ret = sampleElevation(_pos, _elev);
+  pthread_mutex_unlock(&lock);
+
+  return ret;
+}
+
+bool Terrain::sampleElevation(const Loc &_pos, double &_elev)
+{
+  int lat = (int)floor(_pos.lat), lon = (int)floor(_pos.lon), r, c;
+  const int16_t *s;
+  double x, y, fx, fy;
+  Tile *t;
+
+  if ((t = getTile(lat, lon)) == nullptr)
+    return false;
+
+  /**
+   * Bilinear interpolation between the four samples around the position. Do
+   * not interpolate across voids; there is no sensible value to give.
+   */
+  y = (lat + 1 - _pos.lat) * (t->header->rows - 1);
+  x = (_pos.lon - lon) * (t->header->cols - 1);
+  r = ::clamp((int)y, 0, (int)t->header->rows - 2);
+  c = ::clamp((int)x, 0, (int)t->header->cols - 2);
+  fy = y - r;
+  fx = x - c;
+
+  s = t->samples + (size_t)r * t->header->cols + c;
+
+  if (s[0] == TERRAIN_TILE_VOID ||
+      s[1] == TERRAIN_TILE_VOID ||
+      s[t->header->cols] == TERRAIN_TILE_VOID ||
+      s[t->header->cols + 1] == TERRAIN_TILE_VOID)
+    return false;
+
+  _elev = (s[0] * (1.0 - fx) + s[1] * fx) * (1.0 - fy) +
+          (s[t->header->cols] * (1.0 - fx) + s[t->header->cols + 1] * fx) * fy;
+
+  return true;
+}
+
+bool Terrain::getMinClearance(const Loc &_from, double _fromAlt, const Loc &_to, double _toAlt, double &_clearance)
+{
+  double a[3], b[3], v[3], dis, brg, t, n, elev;
+  size_t count, i, j;
+  bool known = false;
+  Loc pos;
+
+  /**
+   * Sample the terrain at even spacing along the great circle from _from to
+   * _to. Positions are interpolated along the chord and projected back onto
+   * the sphere, which is plenty accurate over a glide. Samples without terrain
+   * data are set so low that they never set the minimum.
+   */
+  getDistanceAndBearing(_from, _to, dis, brg);
+  count = ::clamp((size_t)ceil(dis / TERRAIN_PROFILE_SPACING) + 1, (size_t)2, profile.size());
+
+  toUnitVector(_from, a);
+  toUnitVector(_to, b);
+
+  pthread_mutex_lock(&lock);
+
+  for (i = 0; i < count; ++i)
+  {
+    t = (double)i / (count - 1);
+
+    for (j = 0; j < 3; ++j)
+      v[j] = a[j] + (b[j] - a[j]) * t;
+
+    n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    pos.lat = radToDeg(asin(::clamp(v[2] / n, -1.0, 1.0)));
+    pos.lon = radToDeg(atan2(v[1], v[0]));
+
+    if (sampleElevation(pos, elev))
+    {
+      profile[i] = (float)elev;
+      known = true;
+    }
+    else
+      profile[i] = -FLT_MAX;
+  }
+
+  if (known)
+    _clearance = terrainMinClearance(profile.data(), count, (float)_fromAlt, (float)((_toAlt - _fromAlt) / (count - 1)));
+
+  pthread_mutex_unlock(&lock);
+
+  return known;
+}
+
+Terrain::Tile* Terrain::getTile(int _lat, int _lon)
+{
+  Tile *lru = &tiles[0];
+  size_t i;
+
+  for (i = 0; i < tiles.size(); ++i)
+  {
+    Tile &t = tiles[i];
+
+    if (t.lastUse != 0 && t.lat == _lat && t.lon == _lon)
+    {
+      t.lastUse = ++useCount;
+      return (t.loaded ? &t : nullptr);
+    }
+
+    if (t.lastUse < lru->lastUse)
+      lru = &t;
+  }
+
+  unloadTile(*lru);
+  lru->lat = _lat;
+  lru->lon = _lon;
+  lru->lastUse = ++useCount;
+  lru->loaded = loadTile(*lru, _lat, _lon);
+
+  return (lru->loaded ? lru : nullptr);
+}
+
+bool Terrain::loadTile(Tile &_tile, int _lat, int _lon)
+{
+  struct stat st;
+  const TerrainTileHeader *h;
+  char name[32];
+  string path;
+  void *m;
+  int fd;
+
+  tileName(_lat, _lon, name, sizeof(name));
+  path = dir + name;
+
+  fd = ::open(path.c_str(), O_RDONLY);
+
+  if (fd == -1)
+    return false;
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TerrainTileHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (m == MAP_FAILED)
+    return false;
+
+  h = (const TerrainTileHeader*)m;
+
+  if (memcmp(h->magic, TERRAIN_TILE_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != TERRAIN_TILE_VERSION ||
+      h->byteOrder != TERRAIN_TILE_BYTE_ORDER ||
+      h->lat != _lat ||
+      h->lon != _lon ||
+      h->rows < 2 ||
+      h->cols < 2 ||
+      sizeof(TerrainTileHeader) + (u_int64_t)h->rows * h->cols * sizeof(int16_t) > (u_int64_t)st.st_size)
+  {
+    munmap(m, (size_t)st.st_size);
+    return false;
+  }
+
+  // Samples are read a few at a time wherever the aircraft happens to be.
+  madvise(m, (size_t)st.st_size, MADV_RANDOM);
+
+  _tile.map = m;
+  _tile.mapSize = (size_t)st.st_size;
+  _tile.header = h;
+  _tile.samples = (const int16_t*)(h + 1);
+
+  return true;
+}
+
+void Terrain::unloadTile(Tile &_tile)
+{
+  if (_tile.map != nullptr)
+    munmap(_tile.map, _tile.mapSize);
+
+  _tile.loaded = false;
+  _tile.map = nullptr;
+  _tile.mapSize = 0;
+  _tile.header = nullptr;
+  _tile.samples = nullptr;
+}
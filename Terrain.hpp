@@ -0,0 +1,103 @@
+#ifndef Terrain_hpp
+#define Terrain_hpp
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Utilities.hpp"
+
+/**
+ * Terrain tile format written by demtool.
+ *
+ * Each tile covers one degree of latitude and longitude and lives in its own
+ * file named for its south-west corner, e.g. N46W117.dem, like SRTM .hgt
+ * files. A tile is a header followed by a rows x cols array of elevations in
+ * feet, in native byte order. Row 0 is the north edge and column 0 is the west
+ * edge. The edge rows and columns are shared with the neighbouring tiles.
+ */
+
+#define TERRAIN_TILE_MAGIC        "OTTODEM"
+#define TERRAIN_TILE_VERSION      1
+#define TERRAIN_TILE_BYTE_ORDER   0x01020304
+#define TERRAIN_TILE_VOID         (-32768)
+#define TERRAIN_CACHE_TILES       4
+#define TERRAIN_PROFILE_SPACING   0.05    // nm, about the SRTM3 sample spacing
+#define TERRAIN_PROFILE_SAMPLES   2048
+
+struct TerrainTileHeader
+{
+  char magic[8];
+  u_int32_t version;
+  u_int32_t byteOrder;
+  int32_t lat;            // degrees, south edge
+  int32_t lon;            // degrees, west edge
+  u_int32_t rows;
+  u_int32_t cols;
+};
+
+/**
+ * Return the minimum of (_alt + i * _step) - _elev[i] over the _count samples,
+ * i.e. the least clearance of a straight line over a terrain profile. Uses
+ * AVX, SSE2, or NEON where the target supports it.
+ */
+float terrainMinClearance(const float *_elev, size_t _count, float _alt, float _step);
+
+/**
+ * The Terrain class samples elevation from a directory of terrain tiles. Tiles
+ * are mapped read-only on first use and kept in a small least-recently-used
+ * cache, so only the pages around the positions actually sampled are read
+ * from disk. Missing tiles are cached too, so that sampling over an area
+ * without data does not hit the file system every time.
+ *
+ * Lookups are serialized by a lock, so one instance may be shared between the
+ * navigation loop and the recovery worker. Threads that do nothing but sample
+ * terrain are better off with an instance each.
+ */
+class Terrain
+{
+public:
+  static void tileName(int _lat, int _lon, char *_name, size_t _len);
+
+public:
+  Terrain(const char *_dir, size_t _cacheTiles = TERRAIN_CACHE_TILES);
+
+public:
+  ~Terrain();
+
+public:
+  bool getElevation(const Loc &_pos, double &_elev);
+
+  bool getMinClearance(const Loc &_from, double _fromAlt, const Loc &_to, double _toAlt, double &_clearance);
+
+private:
+  struct Tile
+  {
+    int lat;
+    int lon;
+    bool loaded;
+    unsigned long lastUse;
+    void *map;
+    size_t mapSize;
+    const TerrainTileHeader *header;
+    const int16_t *samples;
+  };
+
+  bool sampleElevation(const Loc &_pos, double &_elev);
+
+  Tile* getTile(int _lat, int _lon);
+
+  bool loadTile(Tile &_tile, int _lat, int _lon);
+
+  void unloadTile(Tile &_tile);
+
+private:
+  std::string dir;
+  std::vector<Tile> tiles;
+  std::vector<float> profile;
+  unsigned long useCount;
+  pthread_mutex_t lock;
+};
+
+#endif
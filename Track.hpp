@@ -0,0 +1,202 @@
+#ifndef Track_hpp
+#define Track_hpp
+
+#include "Utilities.hpp"
+
+/**
+ * Track holds a great-circle leg from an origin to a destination, precomputed
+ * from their n-vectors: the unit pole of the great circle (to the right of
+ * the direction of travel), the unit direction of travel at the origin, and
+ * the length. Queries against the leg then need a few multiplies: the
+ * cross-track error is the sine of the angle to the pole's great circle, and
+ * the along-track distance is the angle of the position's projection onto the
+ * leg. Only the along-track distance and the course take an atan2.
+ *
+ * The leg is a great circle on the sphere of radius `earthRadius', so it runs
+ * exactly through both ends; steering to zero cross-track error arrives at
+ * the destination even though distances carry the sphere's error.
+ *
+ * For steering, the overloads taking a Loc and _maxError use the flat model
+ * when geoModelFor() allows it: the cross-track error from crossTrackError()
+ * in Utilities, and the course as the bearing from the point abeam to the
+ * destination. Otherwise they answer from the precomputed leg on the sphere
+ * rather than the ellipsoid, whatever _maxError asks for, so that long legs
+ * cost no more than short ones. Within 3 NM of legs up to 200 NM, the
+ * sphere's cross-track error is within 0.02 NM of the ellipsoid's and its
+ * course within 0.2 degrees; steering absorbs the course bias as a small
+ * steady cross-track error, and the leg still ends at the destination.
+ */
+class Track
+{
+public:
+  Track()
+  : length(0.0)
+  {
+    originLoc.lat = originLoc.lon = 0.0;
+    destLoc = originLoc;
+    origin.x = origin.y = origin.z = 0.0;
+    pole = dir = dest = origin;
+  }
+
+  Track(const Loc &_originLoc, const NVector &_origin, const Loc &_destLoc, const NVector &_dest)
+  {
+    set(_originLoc, _origin, _destLoc, _dest);
+  }
+
+  void set(const Loc &_originLoc, const NVector &_origin, const Loc &_destLoc, const NVector &_dest)
+  {
+    double s, c;
+
+    originLoc = _originLoc;
+    destLoc = _destLoc;
+    dest = _dest;
+
+    /**
+     * pole = dest x origin, normalized; dir = origin x pole. If the ends are
+     * the same point or antipodal the leg is undefined, and every query
+     * answers zero.
+     */
+    origin = _origin;
+    pole.x = _dest.y * _origin.z - _dest.z * _origin.y;
+    pole.y = _dest.z * _origin.x - _dest.x * _origin.z;
+    pole.z = _dest.x * _origin.y - _dest.y * _origin.x;
+
+    s = sqrt(pole.x * pole.x + pole.y * pole.y + pole.z * pole.z);
+    c = _origin.x * _dest.x + _origin.y * _dest.y + _origin.z * _dest.z;
+    length = atan2(s, c) * earthRadius;
+
+    if (s > 0.0)
+    {
+      pole.x /= s;
+      pole.y /= s;
+      pole.z /= s;
+    }
+
+    dir.x = _origin.y * pole.z - _origin.z * pole.y;
+    dir.y = _origin.z * pole.x - _origin.x * pole.z;
+    dir.z = _origin.x * pole.y - _origin.y * pole.x;
+  }
+
+  /**
+   * Length of the leg in NM.
+   */
+  double getLength() const
+  {
+    return length;
+  }
+
+  /**
+   * Cross-track error in NM; negative left of course and positive right of
+   * course, as crossTrackError() in Utilities.
+   */
+  double crossTrackError(const NVector &_p) const
+  {
+    double x = pole.x * _p.x + pole.y * _p.y + pole.z * _p.z, x2 = x * x;
+
+    // asin() by its series; good to 1e-9 radians inside 0.1 radians (340 NM).
+    if (fabs(x) < 0.1)
+      return x * (1.0 + x2 * (1.0 / 6.0 + x2 * (3.0 / 40.0 + x2 * (5.0 / 112.0)))) * earthRadius;
+
+    return asin(std::max(std::min(x, 1.0), -1.0)) * earthRadius;
+  }
+
+  double crossTrackError(const Loc &_p, const NVector &_n, double _maxError) const
+  {
+    double d = std::max(length, nvDistance(origin, _n));
+    double lat = std::max(fabs(originLoc.lat), std::max(fabs(destLoc.lat), fabs(_p.lat)));
+
+    if (geoModelFor(d, _maxError, lat) != geoFlat)
+      return crossTrackError(_n);
+
+    return ::crossTrackError(originLoc, origin, destLoc, dest, _p, _n, _maxError);
+  }
+
+  /**
+   * Distance along the leg from the origin to the point abeam _p, in NM.
+   * Negative if _p is behind the origin.
+   */
+  double alongTrackDistance(const NVector &_p) const
+  {
+    return atan2(dir.x * _p.x + dir.y * _p.y + dir.z * _p.z,
+                 origin.x * _p.x + origin.y * _p.y + origin.z * _p.z) * earthRadius;
+  }
+
+  /**
+   * Distance along the leg from the point abeam _p to the destination, in NM.
+   */
+  double distanceToGo(const NVector &_p) const
+  {
+    return length - alongTrackDistance(_p);
+  }
+
+  /**
+   * True course of the leg, in degrees [0, 360), at the point abeam _p. On a
+   * great circle the course changes along the leg; at the origin this is the
+   * initial bearing to the destination.
+   */
+  double course(const NVector &_p) const
+  {
+    double d[3], e, n, h;
+
+    // The direction of travel at _p is _p x pole.
+    d[0] = _p.y * pole.z - _p.z * pole.y;
+    d[1] = _p.z * pole.x - _p.x * pole.z;
+    d[2] = _p.x * pole.y - _p.y * pole.x;
+
+    // East and north at _p, both scaled by cos(lat); see nvBearing().
+    e = _p.x * d[1] - _p.y * d[0];
+    n = d[2] * (_p.x * _p.x + _p.y * _p.y) - _p.z * (_p.x * d[0] + _p.y * d[1]);
+    h = radToDeg(atan2(e, n));
+
+    return (h < 0.0 ? h + 360.0 : h);
+  }
+
+  double course(const Loc &_p, const NVector &_n, double _maxError) const
+  {
+    NVector a;
+    Loc abeam;
+    double x, s, dis, brg;
+
+    /**
+     * The point abeam _p is _p with its component along the pole removed. On
+     * the leg, the course there is the bearing to the destination. Past the
+     * destination that bearing turns around, so keep to the sphere, as when
+     * the destination is beyond the flat model's reach.
+     */
+    dis = distanceToGo(_n);
+
+    if (dis <= 0.0 ||
+        geoModelFor(dis, _maxError, std::max(fabs(destLoc.lat), fabs(_p.lat))) != geoFlat)
+      return course(_n);
+
+    x = pole.x * _n.x + pole.y * _n.y + pole.z * _n.z;
+    a.x = _n.x - x * pole.x;
+    a.y = _n.y - x * pole.y;
+    a.z = _n.z - x * pole.z;
+    s = sqrt(a.x * a.x + a.y * a.y + a.z * a.z);
+
+    if (s == 0.0)
+      return course(_n);
+
+    a.x /= s;
+    a.y /= s;
+    a.z /= s;
+    abeam.lat = radToDeg(atan2(a.z, sqrt(a.x * a.x + a.y * a.y)));
+    abeam.lon = radToDeg(atan2(a.y, a.x));
+
+    getDistanceAndBearing(abeam, a, destLoc, dest, dis, brg, _maxError);
+
+    return brg;
+  }
+
+private:
+  Loc originLoc;
+  Loc destLoc;
+  NVector origin;
+  NVector dest;
+  NVector pole;
+  NVector dir;
+  double length;
+};
+
+#endif
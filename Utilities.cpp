@@ -3,7 +3,7 @@
 
 using namespace std;
 
-static const double R = 3440.277; //mean Earth radius in NM.
+static const double R = earthRadius;
 
 void getDestination(const Loc &_pos, double _hdg, double _distance, Loc &_dest)
 {
@@ -63,4 +63,669 @@ double crossTrackError(const Loc &_origin, const Loc &_dest, const Loc &_ppos)
   _getDistanceAndBearing(_origin, _ppos, d13, t13);
   
   return asin(sin(d13) * sin(t13 - t12)) * R;
-}
\ No newline at end of file
+}
+
+/**
+ * WGS-84 ellipsoid. Lengths are in NM.
+ */
+static const double wgs84A = 6378137.0 / 1852.0;              // semi-major axis
+static const double wgs84F = 1.0 / 298.257223563;             // flattening
+static const double wgs84B = wgs84A * (1.0 - wgs84F);          // semi-minor axis
+static const double wgs84E2 = wgs84F * (2.0 - wgs84F);         // eccentricity squared
+
+/**
+ * Error bounds for choosing a model, measured against Vincenty's solution
+ * between 80S and 80N with some margin. See geoModelFor().
+ *
+ * The flat model ignores the curvature across the distance, so its error in
+ * distance, destination, and cross-track error grows with the cube of the
+ * distance: at most flatErrorScale * d^3 NM. Toward the poles the error grows
+ * with tan^2 of the latitude, so the flat model is not used above flatMaxLat.
+ *
+ * The sphere's error comes from the ellipsoid's flattening and is
+ * proportional to the distance: at most sphereErrorScale * d NM. Its bearings
+ * are off by up to 0.2 degrees at any distance.
+ */
+static const double flatErrorScale = 2.0e-7;
+static const double sphereErrorScale = 5.7e-3;
+static const double flatMaxLat = 80.0;
+
+static inline double _wrapPi(double _a)
+{
+  return _a - 2.0 * M_PI * floor((_a + M_PI) / (2.0 * M_PI));
+}
+
+/**
+ * Meridional and prime vertical radii of curvature at a latitude, given its
+ * sine.
+ */
+static inline void _radiiOfCurvatureSin(double _sinLat, double &_m, double &_n)
+{
+  double w = 1.0 - wgs84E2 * _sinLat * _sinLat;
+
+  _n = wgs84A / sqrt(w);
+  _m = _n * (1.0 - wgs84E2) / w;
+}
+
+static inline void _radiiOfCurvature(double _lat, double &_m, double &_n)
+{
+  _radiiOfCurvatureSin(sin(_lat), _m, _n);
+}
+
+static void _getDistanceAndBearingFlat(const Loc &_pos1, const Loc &_pos2, double &_distance, double &_bearing)
+{
+  double lat1 = degToRad(_pos1.lat), lat2 = degToRad(_pos2.lat), mid = (lat1 + lat2) / 2.0;
+  double dLon = _wrapPi(degToRad(_pos2.lon - _pos1.lon)), m, n, e, north;
+
+  /**
+   * Project onto the local tangent plane at the midpoint, scaling each axis by
+   * the ellipsoid's radius of curvature there. The direction on the plane is
+   * the course at the midpoint; the meridians converge by half of dLon *
+   * sin(mid) between there and the origin.
+   */
+  _radiiOfCurvature(mid, m, n);
+  north = (lat2 - lat1) * m;
+  e = dLon * n * cos(mid);
+
+  _distance = sqrt(north * north + e * e);
+  _bearing = _wrapPi(atan2(e, north) - dLon / 2.0 * sin(mid));
+}
+
+static void _getDestinationFlat(const Loc &_pos, double _hdg, double _distance, Loc &_dest)
+{
+  double lat = degToRad(_pos.lat), h = degToRad(_hdg), mid = lat, dLon = 0.0, hm = h, m, n;
+  int i;
+
+  /**
+   * The inverse of _getDistanceAndBearingFlat(). The midpoint latitude and
+   * the course there depend on the answer, so refine them twice.
+   */
+  for (i = 0; i < 3; ++i)
+  {
+    _radiiOfCurvature(mid, m, n);
+    hm = h + dLon / 2.0 * sin(mid);
+    mid = lat + _distance * cos(hm) / m / 2.0;
+    dLon = _distance * sin(hm) / (n * cos(mid));
+  }
+
+  _dest.lat = radToDeg(lat + _distance * cos(hm) / m);
+  _dest.lon = _pos.lon + radToDeg(dLon);
+
+  _dest.lat = max(min(_dest.lat, 90.0), -90.0);
+  _dest.lon = fmod(fmod(_dest.lon + 180.0, 360.0) + 360.0, 360.0) - 180.0;
+}
+
+/**
+ * Vincenty's inverse solution on the WGS-84 ellipsoid. Returns false if the
+ * iteration does not converge, which happens only for nearly antipodal
+ * points.
+ */
+static bool _getDistanceAndBearingEllipsoid(const Loc &_pos1, const Loc &_pos2, double &_distance, double &_bearing)
+{
+  double u1 = atan((1.0 - wgs84F) * tan(degToRad(_pos1.lat)));
+  double u2 = atan((1.0 - wgs84F) * tan(degToRad(_pos2.lat)));
+  double l = _wrapPi(degToRad(_pos2.lon - _pos1.lon));
+  double su1 = sin(u1), cu1 = cos(u1), su2 = sin(u2), cu2 = cos(u2);
+  double lambda = l, prev, sl, cl, ss, cs, sigma, sa, c2a, c2sm, c, u2b, a, b, ds;
+  int i;
+
+  for (i = 0; i < 100; ++i)
+  {
+    sl = sin(lambda);
+    cl = cos(lambda);
+    ss = sqrt((cu2 * sl) * (cu2 * sl) + (cu1 * su2 - su1 * cu2 * cl) * (cu1 * su2 - su1 * cu2 * cl));
+
+    if (ss == 0.0)
+    {
+      // Coincident points.
+      _distance = 0.0;
+      _bearing = 0.0;
+      return true;
+    }
+
+    cs = su1 * su2 + cu1 * cu2 * cl;
+    sigma = atan2(ss, cs);
+    sa = cu1 * cu2 * sl / ss;
+    c2a = 1.0 - sa * sa;
+    c2sm = (c2a != 0.0 ? cs - 2.0 * su1 * su2 / c2a : 0.0); // Equatorial line.
+    c = wgs84F / 16.0 * c2a * (4.0 + wgs84F * (4.0 - 3.0 * c2a));
+    prev = lambda;
+    lambda = l + (1.0 - c) * wgs84F * sa * (sigma + c * ss * (c2sm + c * cs * (-1.0 + 2.0 * c2sm * c2sm)));
+
+    if (fabs(lambda - prev) < 1e-12)
+      break;
+  }
+
+  if (i == 100)
+    return false;
+
+  u2b = c2a * (wgs84A * wgs84A - wgs84B * wgs84B) / (wgs84B * wgs84B);
+  a = 1.0 + u2b / 16384.0 * (4096.0 + u2b * (-768.0 + u2b * (320.0 - 175.0 * u2b)));
+  b = u2b / 1024.0 * (256.0 + u2b * (-128.0 + u2b * (74.0 - 47.0 * u2b)));
+  ds = b * ss * (c2sm + b / 4.0 * (cs * (-1.0 + 2.0 * c2sm * c2sm)
+     - b / 6.0 * c2sm * (-3.0 + 4.0 * ss * ss) * (-3.0 + 4.0 * c2sm * c2sm)));
+
+  _distance = wgs84B * a * (sigma - ds);
+  _bearing = atan2(cu2 * sl, cu1 * su2 - su1 * cu2 * cl);
+
+  return true;
+}
+
+/**
+ * Vincenty's direct solution on the WGS-84 ellipsoid.
+ */
+static void _getDestinationEllipsoid(const Loc &_pos, double _hdg, double _distance, Loc &_dest)
+{
+  double h = degToRad(_hdg), sh = sin(h), ch = cos(h);
+  double tu1 = (1.0 - wgs84F) * tan(degToRad(_pos.lat)), cu1 = 1.0 / sqrt(1.0 + tu1 * tu1), su1 = tu1 * cu1;
+  double sigma1 = atan2(tu1, ch), sa = cu1 * sh, c2a = 1.0 - sa * sa;
+  double u2b = c2a * (wgs84A * wgs84A - wgs84B * wgs84B) / (wgs84B * wgs84B);
+  double a = 1.0 + u2b / 16384.0 * (4096.0 + u2b * (-768.0 + u2b * (320.0 - 175.0 * u2b)));
+  double b = u2b / 1024.0 * (256.0 + u2b * (-128.0 + u2b * (74.0 - 47.0 * u2b)));
+  double sigma = _distance / (wgs84B * a), prev, c2sm = 0.0, ss = 0.0, cs = 0.0, ds, x, lambda, c;
+  int i;
+
+  for (i = 0; i < 100; ++i)
+  {
+    c2sm = cos(2.0 * sigma1 + sigma);
+    ss = sin(sigma);
+    cs = cos(sigma);
+    ds = b * ss * (c2sm + b / 4.0 * (cs * (-1.0 + 2.0 * c2sm * c2sm)
+       - b / 6.0 * c2sm * (-3.0 + 4.0 * ss * ss) * (-3.0 + 4.0 * c2sm * c2sm)));
+    prev = sigma;
+    sigma = _distance / (wgs84B * a) + ds;
+
+    if (fabs(sigma - prev) < 1e-12)
+      break;
+  }
+
+  ss = sin(sigma);
+  cs = cos(sigma);
+  c2sm = cos(2.0 * sigma1 + sigma);
+  x = su1 * ss - cu1 * cs * ch;
+
+  _dest.lat = radToDeg(atan2(su1 * cs + cu1 * ss * ch, (1.0 - wgs84F) * sqrt(sa * sa + x * x)));
+  lambda = atan2(ss * sh, cu1 * cs - su1 * ss * ch);
+  c = wgs84F / 16.0 * c2a * (4.0 + wgs84F * (4.0 - 3.0 * c2a));
+  lambda -= (1.0 - c) * wgs84F * sa * (sigma + c * ss * (c2sm + c * cs * (-1.0 + 2.0 * c2sm * c2sm)));
+
+  _dest.lon = radToDeg(_wrapPi(degToRad(_pos.lon) + lambda));
+}
+
+GeoModel geoModelFor(double _distance, double _maxError, double _lat)
+{
+  _distance = fabs(_distance);
+
+  if (fabs(_lat) <= flatMaxLat && flatErrorScale * _distance * _distance * _distance <= _maxError)
+    return geoFlat;
+  if (sphereErrorScale * _distance <= _maxError)
+    return geoSpherical;
+
+  return geoEllipsoid;
+}
+
+void getDistanceAndBearing(const Loc &_pos1, const Loc &_pos2, double &_distance, double &_bearing, double _maxError)
+{
+  double d, t;
+
+  /**
+   * The flat model is cheap enough to use as the distance estimate that picks
+   * the model, and is the answer whenever it is good enough.
+   */
+  _getDistanceAndBearingFlat(_pos1, _pos2, d, t);
+
+  switch (geoModelFor(d, _maxError, max(fabs(_pos1.lat), fabs(_pos2.lat))))
+  {
+  case geoFlat:
+    break;
+  case geoEllipsoid:
+    if (_getDistanceAndBearingEllipsoid(_pos1, _pos2, d, t))
+      break;
+    // Nearly antipodal; the sphere is the best there is.
+  case geoSpherical:
+    _getDistanceAndBearing(_pos1, _pos2, d, t);
+    d *= R;
+    break;
+  }
+
+  _distance = d;
+  _bearing = radToDeg(t);
+  _bearing = (_bearing < 0.0 ? _bearing + 360.0 : _bearing);
+}
+
+void getDestination(const Loc &_pos, double _hdg, double _distance, Loc &_dest, double _maxError)
+{
+  switch (geoModelFor(_distance, _maxError, _pos.lat))
+  {
+  case geoFlat:
+    _getDestinationFlat(_pos, _hdg, _distance, _dest);
+    break;
+  case geoSpherical:
+    getDestination(_pos, _hdg, _distance, _dest);
+    break;
+  case geoEllipsoid:
+    _getDestinationEllipsoid(_pos, _hdg, _distance, _dest);
+    break;
+  }
+}
+
+static inline void _cross(const NVector &_a, const NVector &_b, NVector &_c)
+{
+  _c.x = _a.y * _b.z - _a.z * _b.y;
+  _c.y = _a.z * _b.x - _a.x * _b.z;
+  _c.z = _a.x * _b.y - _a.y * _b.x;
+}
+
+static inline double _dot(const NVector &_a, const NVector &_b)
+{
+  return _a.x * _b.x + _a.y * _b.y + _a.z * _b.z;
+}
+
+static inline double _norm(const NVector &_a)
+{
+  return sqrt(_dot(_a, _a));
+}
+
+/**
+ * Chord length between two n-vectors times the Earth's radius. Shorter than
+ * the great-circle distance by less than d^3 / (24 R^2), 0.03 NM at 200 NM,
+ * which is good enough to choose a model with.
+ */
+static inline double _chordDistance(const NVector &_a, const NVector &_b)
+{
+  NVector d;
+
+  d.x = _a.x - _b.x;
+  d.y = _a.y - _b.y;
+  d.z = _a.z - _b.z;
+
+  return _norm(d) * R;
+}
+
+/**
+ * Angle from _a to _b (radians) and initial bearing (radians, (-pi, pi]).
+ */
+static inline double _nvAngle(const NVector &_a, const NVector &_b)
+{
+  NVector c;
+
+  _cross(_a, _b, c);
+
+  return atan2(_norm(c), _dot(_a, _b));
+}
+
+static inline double _nvBearing(const NVector &_a, const NVector &_b)
+{
+  /**
+   * East and north at _a, both scaled by cos(lat), are (-y, x, 0) and
+   * (-z x, -z y, x^2 + y^2). The direction to _b in the tangent plane has the
+   * same components along them as _b itself.
+   */
+  return atan2(_a.x * _b.y - _a.y * _b.x, _b.z * (_a.x * _a.x + _a.y * _a.y) - _a.z * (_a.x * _b.x + _a.y * _b.y));
+}
+
+static inline double _nvCrossTrackAngle(const NVector &_origin, const NVector &_dest, const NVector &_ppos)
+{
+  NVector c, d;
+
+  // The pole of the track, to the right of it; its length does not matter.
+  _cross(_dest, _origin, c);
+  _cross(c, _ppos, d);
+
+  return atan2(_dot(c, _ppos), _norm(d));
+}
+
+double nvDistance(const NVector &_a, const NVector &_b)
+{
+  return _nvAngle(_a, _b) * R;
+}
+
+double nvBearing(const NVector &_a, const NVector &_b)
+{
+  double b = radToDeg(_nvBearing(_a, _b));
+  return (b < 0.0 ? b + 360.0 : b);
+}
+
+double nvCrossTrackError(const NVector &_origin, const NVector &_dest, const NVector &_ppos)
+{
+  return _nvCrossTrackAngle(_origin, _dest, _ppos) * R;
+}
+
+/**
+ * Local tangent plane components, east and north in NM, of _pos2 from _pos1,
+ * as in _getDistanceAndBearingFlat(), rotated by the convergence of the
+ * meridians so that they point along the initial course. The sine and cosine
+ * of the mean latitude come from the n-vectors by the half-angle identities.
+ * The convergence angle is under 0.04 radians wherever the flat model is
+ * used, so its sine and cosine are taken from their series.
+ */
+static void _flatVector(const Loc &_pos1, const NVector &_n1, const Loc &_pos2, const NVector &_n2, double &_east, double &_north)
+{
+  double dLon = _wrapPi(degToRad(_pos2.lon - _pos1.lon)), c1, c2, h, sm, cm, m, n, e, north, g, g2, sg, cg;
+
+  c1 = sqrt(_n1.x * _n1.x + _n1.y * _n1.y);
+  c2 = sqrt(_n2.x * _n2.x + _n2.y * _n2.y);
+
+  // h = 2 cos((lat1 - lat2) / 2), zero only from pole to pole.
+  h = 2.0 * sqrt(max((1.0 + c1 * c2 + _n1.z * _n2.z) / 2.0, 0.0));
+  sm = (h > 0.0 ? (_n1.z + _n2.z) / h : 0.0);
+  cm = (h > 0.0 ? (c1 + c2) / h : 1.0);
+
+  _radiiOfCurvatureSin(sm, m, n);
+  north = degToRad(_pos2.lat - _pos1.lat) * m;
+  e = dLon * n * cm;
+
+  g = dLon / 2.0 * sm;
+  g2 = g * g;
+  sg = g * (1.0 - g2 / 6.0 * (1.0 - g2 / 20.0));
+  cg = 1.0 - g2 / 2.0 * (1.0 - g2 / 12.0);
+
+  _east = e * cg - north * sg;
+  _north = north * cg + e * sg;
+}
+
+void getDistanceAndBearing(const Loc &_pos1, const NVector &_n1, const Loc &_pos2, const NVector &_n2,
+                           double &_distance, double &_bearing, double _maxError)
+{
+  double d, t, e, n;
+
+  switch (geoModelFor(_chordDistance(_n1, _n2), _maxError, max(fabs(_pos1.lat), fabs(_pos2.lat))))
+  {
+  case geoFlat:
+    _flatVector(_pos1, _n1, _pos2, _n2, e, n);
+    d = sqrt(e * e + n * n);
+    t = atan2(e, n);
+    break;
+  case geoEllipsoid:
+    if (_getDistanceAndBearingEllipsoid(_pos1, _pos2, d, t))
+      break;
+    // Nearly antipodal; the sphere is the best there is.
+  case geoSpherical:
+  default:
+    d = _nvAngle(_n1, _n2) * R;
+    t = _nvBearing(_n1, _n2);
+    break;
+  }
+
+  _distance = d;
+  _bearing = radToDeg(t);
+  _bearing = (_bearing < 0.0 ? _bearing + 360.0 : _bearing);
+}
+
+double crossTrackError(const Loc &_origin, const NVector &_nOrigin, const Loc &_dest, const NVector &_nDest,
+                       const Loc &_ppos, const NVector &_nPpos, double _maxError)
+{
+  double d12, d13, t12, t13, e12, n12, e13, n13, lat;
+
+  lat = max(fabs(_origin.lat), max(fabs(_dest.lat), fabs(_ppos.lat)));
+
+  switch (geoModelFor(max(_chordDistance(_nOrigin, _nDest), _chordDistance(_nOrigin, _nPpos)), _maxError, lat))
+  {
+  case geoFlat:
+    // The perpendicular component of origin->ppos, by the 2D cross product.
+    _flatVector(_origin, _nOrigin, _dest, _nDest, e12, n12);
+    _flatVector(_origin, _nOrigin, _ppos, _nPpos, e13, n13);
+    d12 = sqrt(e12 * e12 + n12 * n12);
+    return (d12 > 0.0 ? (n12 * e13 - e12 * n13) / d12 : 0.0);
+  case geoEllipsoid:
+    if (_getDistanceAndBearingEllipsoid(_origin, _dest, d12, t12) &&
+        _getDistanceAndBearingEllipsoid(_origin, _ppos, d13, t13))
+      return asin(sin(d13 / R) * sin(t13 - t12)) * R;
+    // Nearly antipodal; the sphere is the best there is.
+  case geoSpherical:
+  default:
+    break;
+  }
+
+  return _nvCrossTrackAngle(_nOrigin, _nDest, _nPpos) * R;
+}
+
+/**
+ * Batched geodesy kernels.
+ *
+ * The kernels run GEO_LANES points at a time through GCC/Clang vector types,
+ * which compile to SSE/AVX on x86 and NEON on AArch64. sin, cos, and atan2 are
+ * replaced with branch-free polynomial approximations (Cephes coefficients)
+ * that work on whole vectors; quadrant and octant selection is done with
+ * masks instead of branches. The last partial block is padded by repeating
+ * its final point, so every point goes through exactly the same code.
+ */
+#if defined(__GNUC__)
+#define GEO_LANES 4
+typedef double GeoLanes __attribute__((vector_size(GEO_LANES * sizeof(double))));
+
+template<typename M>
+static inline GeoLanes _select(const M &_mask, const GeoLanes &_a, const GeoLanes &_b)
+{
+  return (GeoLanes)((_mask & (M)_a) | (~_mask & (M)_b));
+}
+
+static inline GeoLanes _sqrt(const GeoLanes &_x)
+{
+  GeoLanes r;
+
+  for (int j = 0; j < GEO_LANES; ++j)
+    r[j] = sqrt(_x[j]);
+
+  return r;
+}
+#else
+#define GEO_LANES 1
+typedef double GeoLanes;
+
+static inline double _select(bool _mask, double _a, double _b)
+{
+  return (_mask ? _a : _b);
+}
+
+static inline double _sqrt(double _x)
+{
+  return sqrt(_x);
+}
+#endif
+
+static const double piOver2Hi = 1.57079632673412561417e+00;  // first 33 bits of pi/2
+static const double piOver2Lo = 6.07710050650619224932e-11;  // pi/2 - piOver2Hi
+static const double roundMagic = 6755399441055744.0;          // 1.5 * 2^52
+
+static inline GeoLanes _splat(double _x)
+{
+  GeoLanes v = {};
+  return v + _x;
+}
+
+static inline GeoLanes _round(const GeoLanes &_x)
+{
+  // Adding and removing 1.5 * 2^52 rounds to the nearest integer for |x| < 2^51.
+  return (_x + roundMagic) - roundMagic;
+}
+
+static inline GeoLanes _abs(const GeoLanes &_x)
+{
+  return _select(_x < 0.0, -_x, _x);
+}
+
+/**
+ * sin and cos of _x. The argument is reduced to [-pi/4, pi/4] with a two-part
+ * pi/2, so the result is good to a few ulp for the angles that appear here.
+ */
+static inline void _sinCos(const GeoLanes &_x, GeoLanes &_sin, GeoLanes &_cos)
+{
+  GeoLanes k, r, z, s, c, q, h, o;
+
+  k = _round(_x * (2.0 / M_PI));
+  r = (_x - k * piOver2Hi) - k * piOver2Lo;
+  z = r * r;
+
+  s = r + r * z * (((((1.58962301576546568060e-10 * z - 2.50507477628578072866e-8) * z
+    + 2.75573136213857245213e-6) * z - 1.98412698295895385996e-4) * z
+    + 8.33333333332211858878e-3) * z - 1.66666666666666307295e-1);
+  c = 1.0 - 0.5 * z + z * z * (((((-1.13585365213876817300e-11 * z + 2.08757008419747316778e-9) * z
+    - 2.75573141792967388112e-7) * z + 2.48015872888517045348e-5) * z
+    - 1.38888888888730564116e-3) * z + 4.16666666666665929218e-2);
+
+  /**
+   * q is the quadrant, 0-3; h is 1 in the lower half-plane and o is 1 in the
+   * odd quadrants, where sin and cos trade places.
+   */
+  q = k - 4.0 * _round(k * 0.25 - 0.375);
+  h = _round(q * 0.5 - 0.25);
+  o = q - 2.0 * h;
+
+  _sin = _select(o > 0.5, c, s) * (1.0 - 2.0 * h);
+  _cos = _select(o > 0.5, s, c) * (1.0 - 2.0 * (h - o) * (h - o));
+}
+
+/**
+ * atan2(_y, _x) in (-pi, pi]. The ratio of the smaller to the larger operand
+ * is reduced to [0, 0.66] and fed to a rational approximation, then the
+ * octant is restored.
+ */
+static inline GeoLanes _atan2(const GeoLanes &_y, const GeoLanes &_x)
+{
+  GeoLanes ax = _abs(_x), ay = _abs(_y), mx, mn, t, u, z, a;
+
+  mx = _select(ay > ax, ay, ax);
+  mn = _select(ay > ax, ax, ay);
+  t = mn / _select(mx == 0.0, mx + 1.0, mx);
+  u = _select(t > 0.66, (t - 1.0) / (t + 1.0), t);
+  z = u * u;
+
+  a = z * ((((-8.750608600031904122785e-1 * z - 1.615753718733365076637e1) * z
+    - 7.500855792314704667340e1) * z - 1.228866684490136173410e2) * z - 6.485021904942025371773e1)
+    / (((((z + 2.485846490142306297962e1) * z + 1.650270098316988542046e2) * z
+    + 4.328810604912902668951e2) * z + 4.853903996359136964868e2) * z + 1.945506571482613964425e2);
+  a = u * a + u;
+  a = a + _select(t > 0.66, _splat(M_PI / 4.0 + 3.061616997868383e-17), _splat(0.0));
+
+  a = _select(ay > ax, M_PI / 2.0 - a, a);
+  a = _select(_x < 0.0, M_PI - a, a);
+
+  return _select(_y < 0.0, -a, a);
+}
+
+static inline GeoLanes _asin(const GeoLanes &_x)
+{
+  return _atan2(_x, _sqrt((1.0 - _x) * (1.0 + _x)));
+}
+
+static inline GeoLanes _load(const double *_p, size_t _n)
+{
+  GeoLanes v;
+  size_t j;
+
+  for (j = 0; j < GEO_LANES; ++j)
+    ((double*)&v)[j] = _p[min(j, _n - 1)];
+
+  return v;
+}
+
+static inline void _store(double *_p, const GeoLanes &_v, size_t _n)
+{
+  for (size_t j = 0; j < _n && j < GEO_LANES; ++j)
+    _p[j] = ((const double*)&_v)[j];
+}
+
+/**
+ * Origin terms shared by every point in a batch.
+ */
+struct GeoOrigin
+{
+  double lat;
+  double lon;
+  double sinLat;
+  double cosLat;
+
+  GeoOrigin(const Loc &_pos)
+  : lat(degToRad(_pos.lat)),
+    lon(degToRad(_pos.lon)),
+    sinLat(sin(lat)),
+    cosLat(cos(lat))
+  {
+  }
+};
+
+/**
+ * Haversine distance (radians) and initial bearing (radians, (-pi, pi]) from
+ * the origin to each lane, as _getDistanceAndBearing() computes them. sin and
+ * cos of half of the longitude difference give both the haversine term and,
+ * by the double-angle identities, the bearing terms.
+ */
+static inline void _distanceAndBearing(const GeoOrigin &_o, const GeoLanes &_lat, const GeoLanes &_lon, GeoLanes &_d, GeoLanes &_t)
+{
+  GeoLanes lat2 = _lat * (M_PI / 180.0), sl2, cl2, sh, ch, sg, cg, a, x, y;
+
+  _sinCos(lat2, sl2, cl2);
+  _sinCos((lat2 - _o.lat) * 0.5, sh, ch);
+  _sinCos((_lon * (M_PI / 180.0) - _o.lon) * 0.5, sg, cg);
+
+  a = sh * sh + _o.cosLat * cl2 * sg * sg;
+  a = _select(a > 1.0, _splat(1.0), a);
+  _d = 2.0 * _atan2(_sqrt(a), _sqrt(1.0 - a));
+
+  x = 2.0 * sg * cg * cl2;
+  y = _o.cosLat * sl2 - _o.sinLat * cl2 * (1.0 - 2.0 * sg * sg);
+  _t = _atan2(x, y);
+}
+
+void getDistancesAndBearings(const Loc &_pos, const double *_lat, const double *_lon, size_t _count, double *_distance, double *_bearing)
+{
+  GeoOrigin o(_pos);
+  GeoLanes d, t;
+  size_t i, n;
+
+  for (i = 0; i < _count; i += GEO_LANES)
+  {
+    n = min((size_t)GEO_LANES, _count - i);
+    _distanceAndBearing(o, _load(_lat + i, n), _load(_lon + i, n), d, t);
+
+    t = t * (180.0 / M_PI);
+    _store(_distance + i, d * R, n);
+    _store(_bearing + i, _select(t < 0.0, t + 360.0, t), n);
+  }
+}
+
+void getDestinations(const Loc &_pos, const double *_hdg, const double *_distance, size_t _count, double *_lat, double *_lon)
+{
+  GeoOrigin o(_pos);
+  GeoLanes sh, ch, sd, cd, lat, lon;
+  size_t i, n;
+
+  for (i = 0; i < _count; i += GEO_LANES)
+  {
+    n = min((size_t)GEO_LANES, _count - i);
+    _sinCos(_load(_hdg + i, n) * (M_PI / 180.0), sh, ch);
+    _sinCos(_load(_distance + i, n) * (1.0 / R), sd, cd);
+
+    lat = _asin(o.sinLat * cd + o.cosLat * sd * ch);
+    lon = o.lon + _atan2(sh * sd * o.cosLat, cd - o.sinLat * (o.sinLat * cd + o.cosLat * sd * ch));
+
+    lat = lat * (180.0 / M_PI);
+    lon = lon * (180.0 / M_PI);
+    lat = _select(lat > 90.0, _splat(90.0), _select(lat < -90.0, _splat(-90.0), lat));
+    lon = _select(lon > 180.0, _splat(180.0), _select(lon < -180.0, _splat(-180.0), lon));
+
+    _store(_lat + i, lat, n);
+    _store(_lon + i, lon, n);
+  }
+}
+
+void crossTrackErrors(const Loc &_origin, const Loc &_dest, const double *_lat, const double *_lon, size_t _count, double *_xte)
+{
+  GeoOrigin o(_origin);
+  GeoLanes d, t, sd, cd, st, ct;
+  double d12, t12;
+  size_t i, n;
+
+  _getDistanceAndBearing(_origin, _dest, d12, t12);
+
+  for (i = 0; i < _count; i += GEO_LANES)
+  {
+    n = min((size_t)GEO_LANES, _count - i);
+    _distanceAndBearing(o, _load(_lat + i, n), _load(_lon + i, n), d, t);
+
+    _sinCos(d, sd, cd);
+    _sinCos(t - t12, st, ct);
+    _store(_xte + i, _asin(sd * st) * R, n);
+  }
+}
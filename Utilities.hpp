@@ -2,6 +2,7 @@
 #define Utilities_hpp
 
 #include <cmath>
+#include <cstddef>
 #include <algorithm>
 
 template<typename T>
@@ -25,18 +26,143 @@ inline double radToDeg(double _rad)
   return (_rad * 180.0 / M_PI);
 }
 
+/**
+ * Wraps an angle difference in degrees into [-180, 180). Differences of two
+ * headings are within a turn of that range, where this is a compare and an
+ * add rather than two fmod() calls.
+ */
+inline double wrap180(double _deg)
+{
+  if (_deg < -540.0 || _deg >= 540.0)
+    _deg = fmod(_deg, 360.0);
+
+  if (_deg >= 180.0)
+    _deg -= 360.0;
+  else if (_deg < -180.0)
+    _deg += 360.0;
+
+  return _deg;
+}
+
 #define COUNTOF(a) (sizeof(a) / sizeof((a)[0]))
 
+static const double earthRadius = 3440.277; // mean Earth radius in NM.
+
 struct Loc
 {
   double lat;
   double lon;
 };
 
+inline void toUnitVector(const Loc &_pos, double _v[3])
+{
+  double lat = degToRad(_pos.lat), lon = degToRad(_pos.lon);
+
+  _v[0] = cos(lat) * cos(lon);
+  _v[1] = cos(lat) * sin(lon);
+  _v[2] = sin(lat);
+}
+
+/**
+ * n-vector: the unit normal to the Earth at a position, in Earth-centered
+ * coordinates with x toward 0N 0E and z toward the North Pole. A position's
+ * n-vector costs four transcendental calls once; after that, great-circle
+ * distances, bearings, and cross-track errors between n-vectors need only dot
+ * and cross products and one atan2. Positions that are used more than once,
+ * recovery locations and samples, carry their n-vector with them.
+ */
+struct NVector
+{
+  double x;
+  double y;
+  double z;
+};
+
+inline void toNVector(const Loc &_pos, NVector &_n)
+{
+  double v[3];
+
+  toUnitVector(_pos, v);
+  _n.x = v[0];
+  _n.y = v[1];
+  _n.z = v[2];
+}
+
 void getDestination(const Loc &_pos, double _hdg, double _distance, Loc &_dest);
 
 void getDistanceAndBearing(const Loc &_pos1, const Loc &_pos2, double &_distance, double &_bearing);
 
 double crossTrackError(const Loc &_origin, const Loc &_dest, const Loc &_ppos);
 
+/**
+ * Earth models, cheapest first. The functions above use the sphere.
+ *
+ *   geoFlat       Local tangent plane scaled by the WGS-84 radii of curvature,
+ *                 below 80 degrees of latitude. Error grows with the cube of
+ *                 the distance: 2e-4 NM at 10 NM, 0.025 NM at 50 NM. It beats
+ *                 the sphere out to about 200 NM.
+ *   geoSpherical  Haversine on a sphere of radius `earthRadius'. Error is up
+ *                 to 0.57% of the distance, and 0.2 degrees of bearing, from
+ *                 ignoring the flattening.
+ *   geoEllipsoid  Vincenty's solutions on the WGS-84 ellipsoid, good to well
+ *                 under a meter.
+ *
+ * geoModelFor() returns the cheapest model whose error at _distance is within
+ * _maxError NM. The overloads below taking _maxError use it to pick a model
+ * per call; callers state the error they can tolerate rather than a model.
+ */
+enum GeoModel
+{
+  geoFlat,
+  geoSpherical,
+  geoEllipsoid
+};
+
+GeoModel geoModelFor(double _distance, double _maxError, double _lat = 0.0);
+
+void getDestination(const Loc &_pos, double _hdg, double _distance, Loc &_dest, double _maxError);
+
+void getDistanceAndBearing(const Loc &_pos1, const Loc &_pos2, double &_distance, double &_bearing, double _maxError);
+
+/**
+ * Great-circle distance (NM), initial bearing (degrees, [0, 360)), and
+ * cross-track error (NM, negative left of course) on the sphere, from
+ * n-vectors. These agree with the spherical Loc versions to rounding.
+ */
+double nvDistance(const NVector &_a, const NVector &_b);
+
+double nvBearing(const NVector &_a, const NVector &_b);
+
+double nvCrossTrackError(const NVector &_origin, const NVector &_dest, const NVector &_ppos);
+
+/**
+ * Budgeted versions for positions that carry an n-vector. Choosing the model
+ * and the flat model's midpoint terms come from the n-vectors, so the flat
+ * and spherical tiers need one atan2 per distance and bearing and no sin or
+ * cos.
+ */
+void getDistanceAndBearing(const Loc &_pos1, const NVector &_n1, const Loc &_pos2, const NVector &_n2,
+                           double &_distance, double &_bearing, double _maxError);
+
+double crossTrackError(const Loc &_origin, const NVector &_nOrigin, const Loc &_dest, const NVector &_nDest,
+                       const Loc &_ppos, const NVector &_nPpos, double _maxError);
+
+/**
+ * Structure-of-arrays versions of the functions above for scoring many points
+ * against one origin. Positions are given as parallel arrays of degrees, and
+ * results have the same units as the single-point versions.
+ *
+ * The batch kernels use SIMD polynomial approximations of sin, cos, and atan2
+ * in place of the C library. Against the single-point versions, over the
+ * whole globe and distances up to 10,000 NM, the errors stay below 1e-9 NM in
+ * distance and cross-track error, 1e-9 degrees in bearing, and 1e-10 degrees
+ * in destination latitude and longitude. rasppi/tests/bench_geodesy checks
+ * these bounds and times both paths.
+ */
+void getDistancesAndBearings(const Loc &_pos, const double *_lat, const double *_lon, size_t _count, double *_distance, double *_bearing);
+
+void getDestinations(const Loc &_pos, const double *_hdg, const double *_distance, size_t _count, double *_lat, double *_lon);
+
+void crossTrackErrors(const Loc &_origin, const Loc &_dest, const double *_lat, const double *_lon, size_t _count, double *_xte);
+
 #endif
@@ -0,0 +1,568 @@
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <Utilities.hpp>
+#include "RecoveryImporter.hpp"
+
+using namespace std;
+
+static const double nm2ft = 6076.12;
+
+struct SurfaceName
+{
+  const char *name;
+  unsigned int surface;
+};
+
+static const SurfaceName surfaceNames[] = {
+  { "paved",  surfPaved },
+  { "grass",  surfGrass },
+  { "dirt",   surfDirt },
+  { "gravel", surfGravel },
+  { "snow",   surfSnow },
+  { "water",  surfWater },
+  { "other",  surfOther }
+};
+
+/**
+ * Prefixes of free-form surface descriptions, checked in order. GRAV must be
+ * checked before GRA so that gravel is not taken for grass.
+ */
+static const SurfaceName surfacePrefixes[] = {
+  { "ASP",    surfPaved },
+  { "CON",    surfPaved },
+  { "BIT",    surfPaved },
+  { "PEM",    surfPaved },
+  { "PAV",    surfPaved },
+  { "TAR",    surfPaved },
+  { "BRI",    surfPaved },
+  { "GRAV",   surfGravel },
+  { "GRV",    surfGravel },
+  { "GVL",    surfGravel },
+  { "GRS",    surfGrass },
+  { "GRA",    surfGrass },
+  { "TURF",   surfGrass },
+  { "DIRT",   surfDirt },
+  { "DRT",    surfDirt },
+  { "EARTH",  surfDirt },
+  { "CLAY",   surfDirt },
+  { "SAND",   surfDirt },
+  { "SOIL",   surfDirt },
+  { "WAT",    surfWater },
+  { "SNOW",   surfSnow },
+  { "ICE",    surfSnow }
+};
+
+/**
+ * Column names, in order of preference, for the OurAirports and FAA NASR
+ * airport and runway files.
+ */
+static const char *identColumns[] = { "ident", "ARPT_ID" };
+static const char *latColumns[] = { "latitude_deg", "LAT_DECIMAL" };
+static const char *lonColumns[] = { "longitude_deg", "LONG_DECIMAL" };
+static const char *elevColumns[] = { "elevation_ft", "ELEV" };
+static const char *typeColumns[] = { "type", "SITE_TYPE_CODE" };
+static const char *rwyAirportColumns[] = { "airport_ident", "ARPT_ID" };
+static const char *rwyLengthColumns[] = { "length_ft", "RWY_LEN" };
+static const char *rwySurfaceColumns[] = { "surface", "SURFACE_TYPE_CODE" };
+static const char *rwyClosedColumns[] = { "closed" };
+
+/**
+ * Airport types that are never recovery locations: OurAirports types, then
+ * FAA site type codes.
+ */
+static const char *rejectedTypes[] = {
+  "heliport", "seaplane_base", "balloonport", "closed",
+  "H", "S", "B"
+};
+
+/**
+ * Reads one CSV record, joining lines while a quoted field is open. Returns
+ * false at the end of the input.
+ */
+static bool readCsvRecord(FILE *_in, string &_record)
+{
+  bool quoted = false;
+  int c;
+
+  _record.clear();
+
+  while ((c = fgetc(_in)) != EOF)
+  {
+    if (c == '"')
+      quoted = !quoted;
+    else if (c == '\n' && !quoted)
+      return true;
+
+    _record.push_back((char)c);
+  }
+
+  return !_record.empty();
+}
+
+/**
+ * Splits a CSV record into fields, removing quotes and trailing carriage
+ * returns. The field strings are reused from record to record.
+ */
+static void splitCsvRecord(const string &_record, vector<string> &_fields)
+{
+  size_t n = 0, i;
+  bool quoted = false;
+
+  if (_fields.empty())
+    _fields.resize(1);
+
+  _fields[0].clear();
+
+  for (i = 0; i < _record.size(); ++i)
+  {
+    char c = _record[i];
+
+    if (c == '"')
+    {
+      // A doubled quote inside a quoted field is a literal quote.
+      if (quoted && i + 1 < _record.size() && _record[i + 1] == '"')
+        _fields[n].push_back(_record[++i]);
+      else
+        quoted = !quoted;
+    }
+    else if (c == ',' && !quoted)
+    {
+      if (++n == _fields.size())
+        _fields.resize(n + 1);
+
+      _fields[n].clear();
+    }
+    else if (c != '\r' || quoted)
+      _fields[n].push_back(c);
+  }
+
+  _fields.resize(n + 1);
+}
+
+static int findColumn(const vector<string> &_header, const char **_names, size_t _count)
+{
+  size_t i, j;
+
+  for (i = 0; i < _count; ++i)
+  {
+    for (j = 0; j < _header.size(); ++j)
+    {
+      if (_header[j] == _names[i])
+        return (int)j;
+    }
+  }
+
+  return -1;
+}
+
+static const char* field(const vector<string> &_fields, int _col)
+{
+  return (_col >= 0 && (size_t)_col < _fields.size() ? _fields[_col].c_str() : "");
+}
+
+static unsigned int aptDatSurface(int _code)
+{
+  /**
+   * X-Plane surface codes: 1 asphalt, 2 concrete, 3 grass, 4 dirt, 5 gravel,
+   * 12 dry lakebed, 13 water, 14 snow or ice, 15 transparent. X-Plane 12 adds
+   * asphalt shades 20-38 and concrete shades 50-57.
+   */
+  if (_code == 1 || _code == 2 || (_code >= 20 && _code <= 38) || (_code >= 50 && _code <= 57))
+    return surfPaved;
+
+  switch (_code)
+  {
+  case 3:
+    return surfGrass;
+  case 4:
+  case 12:
+    return surfDirt;
+  case 5:
+    return surfGravel;
+  case 13:
+    return surfWater;
+  case 14:
+    return surfSnow;
+  default:
+    return surfOther;
+  }
+}
+
+bool RunwayFilter::accepts(double _length, unsigned int _surface) const
+{
+  return (_length >= minLength && (_surface & surfaces) != 0);
+}
+
+bool parseRunwaySurfaces(const char *_list, unsigned int &_surfaces)
+{
+  const char *p = _list, *end;
+  size_t len, i;
+
+  _surfaces = 0;
+
+  while (*p != 0)
+  {
+    end = strchr(p, ',');
+    len = (end != nullptr ? (size_t)(end - p) : strlen(p));
+
+    for (i = 0; i < COUNTOF(surfaceNames); ++i)
+    {
+      if (strlen(surfaceNames[i].name) == len && strncasecmp(p, surfaceNames[i].name, len) == 0)
+        break;
+    }
+
+    if (i == COUNTOF(surfaceNames))
+      return false;
+
+    _surfaces |= surfaceNames[i].surface;
+    p += len + (end != nullptr ? 1 : 0);
+  }
+
+  return (_surfaces != 0);
+}
+
+unsigned int classifyRunwaySurface(const char *_surface)
+{
+  size_t i;
+
+  while (isspace((unsigned char)*_surface))
+    ++_surface;
+
+  for (i = 0; i < COUNTOF(surfacePrefixes); ++i)
+  {
+    if (strncasecmp(_surface, surfacePrefixes[i].name, strlen(surfacePrefixes[i].name)) == 0)
+      return surfacePrefixes[i].surface;
+  }
+
+  return surfOther;
+}
+
+RecoveryImporter::RecoveryImporter(const RunwayFilter &_filter)
+: filter(_filter),
+  rejectCount(0)
+{
+
+}
+
+RecoveryImporter::~RecoveryImporter()
+{
+
+}
+
+size_t RecoveryImporter::rejected() const
+{
+  return rejectCount;
+}
+
+AptDatImporter::AptDatImporter(const RunwayFilter &_filter)
+: RecoveryImporter(_filter),
+  in(nullptr),
+  line(nullptr),
+  lineCap(0),
+  atEnd(false)
+{
+  memset(&airport, 0, sizeof(airport));
+}
+
+AptDatImporter::~AptDatImporter()
+{
+  close();
+  free(line);
+}
+
+bool AptDatImporter::open(const char *_path)
+{
+  close();
+
+  in = fopen(_path, "r");
+  atEnd = false;
+  airport.active = false;
+
+  return (in != nullptr);
+}
+
+void AptDatImporter::close()
+{
+  if (in != nullptr)
+    fclose(in);
+
+  in = nullptr;
+}
+
+int AptDatImporter::next(ImportRow &_row)
+{
+  ssize_t len;
+  bool found;
+  int code;
+
+  if (in == nullptr)
+    return -1;
+
+  while (!atEnd)
+  {
+    len = getline(&line, &lineCap, in);
+
+    if (len < 0 && ferror(in))
+      return -1;
+
+    // The file header (`I' or `A' and the version line) parses as code 0.
+    code = (len < 0 ? 99 : atoi(line));
+
+    switch (code)
+    {
+    case 1:       // land airport
+    case 16:      // seaplane base
+    case 17:      // heliport
+    case 99:      // end of file
+      found = finishAirport(_row);
+
+      if (code == 99)
+        atEnd = true;
+      else
+        startAirport(code, line);
+
+      if (found)
+        return 1;
+
+      break;
+    case 100:     // land runway
+      addRunway(line);
+      break;
+    default:
+      break;
+    }
+  }
+
+  return 0;
+}
+
+bool AptDatImporter::finishAirport(ImportRow &_row)
+{
+  if (!airport.active)
+    return false;
+
+  airport.active = false;
+
+  if (!airport.land || airport.bestLength < 0.0)
+  {
+    ++rejectCount;
+    return false;
+  }
+
+  _row = airport.row;
+
+  return true;
+}
+
+void AptDatImporter::startAirport(int _code, const char *_line)
+{
+  char ident[sizeof(airport.row.ident)];
+
+  memset(&airport, 0, sizeof(airport));
+  airport.active = true;
+  airport.land = (_code == 1);
+  airport.bestLength = -1.0;
+
+  // 1 <elevation> <deprecated> <deprecated> <ICAO code> <name...>
+  if (sscanf(_line, "%*d %lf %*s %*s %31s", &airport.row.elev, ident) != 2)
+  {
+    airport.land = false;
+    return;
+  }
+
+  memcpy(airport.row.ident, ident, sizeof(ident));
+}
+
+void AptDatImporter::addRunway(const char *_line)
+{
+  Loc end1, end2;
+  double v1[3], v2[3], chord, length;
+  int surface;
+
+  if (!airport.active || !airport.land)
+    return;
+
+  /**
+   * 100 <width> <surface> <shoulder> <smoothness> <centreline lights>
+   * <edge lights> <distance signs>, then for each end <number> <lat> <lon>
+   * <displaced threshold> <overrun> <markings> <approach lights> <TDZ lights>
+   * <REIL>.
+   */
+  if (sscanf(_line,
+             "%*d %*f %d %*s %*s %*s %*s %*s %*s %lf %lf %*s %*s %*s %*s %*s %*s %*s %lf %lf",
+             &surface, &end1.lat, &end1.lon, &end2.lat, &end2.lon) != 5)
+    return;
+
+  toUnitVector(end1, v1);
+  toUnitVector(end2, v2);
+  chord = sqrt((v1[0] - v2[0]) * (v1[0] - v2[0]) +
+               (v1[1] - v2[1]) * (v1[1] - v2[1]) +
+               (v1[2] - v2[2]) * (v1[2] - v2[2]));
+  length = 2.0 * asin(min(chord / 2.0, 1.0)) * earthRadius * nm2ft;
+
+  if (!filter.accepts(length, aptDatSurface(surface)) || length <= airport.bestLength)
+    return;
+
+  // Place the airport at the middle of its best runway.
+  airport.bestLength = length;
+  airport.row.lat = (end1.lat + end2.lat) / 2.0;
+  airport.row.lon = (end1.lon + end2.lon) / 2.0;
+
+  if (fabs(end1.lon - end2.lon) > 180.0)
+    airport.row.lon += (airport.row.lon > 0.0 ? -180.0 : 180.0);
+}
+
+AirportCsvImporter::AirportCsvImporter(const RunwayFilter &_filter, const char *_runwaysPath)
+: RecoveryImporter(_filter),
+  runwaysPath(_runwaysPath != nullptr ? _runwaysPath : ""),
+  in(nullptr),
+  identCol(-1),
+  latCol(-1),
+  lonCol(-1),
+  elevCol(-1),
+  typeCol(-1),
+  haveRunways(false)
+{
+
+}
+
+AirportCsvImporter::~AirportCsvImporter()
+{
+  close();
+}
+
+void AirportCsvImporter::close()
+{
+  if (in != nullptr)
+    fclose(in);
+
+  in = nullptr;
+}
+
+bool AirportCsvImporter::loadRunways()
+{
+  int airportCol, lengthCol, surfaceCol, closedCol;
+  FILE *rwy;
+
+  runways.clear();
+
+  rwy = fopen(runwaysPath.c_str(), "r");
+
+  if (rwy == nullptr)
+    return false;
+
+  if (!readCsvRecord(rwy, record))
+  {
+    fclose(rwy);
+    return false;
+  }
+
+  splitCsvRecord(record, fields);
+  airportCol = findColumn(fields, rwyAirportColumns, COUNTOF(rwyAirportColumns));
+  lengthCol = findColumn(fields, rwyLengthColumns, COUNTOF(rwyLengthColumns));
+  surfaceCol = findColumn(fields, rwySurfaceColumns, COUNTOF(rwySurfaceColumns));
+  closedCol = findColumn(fields, rwyClosedColumns, COUNTOF(rwyClosedColumns));
+
+  if (airportCol == -1 || lengthCol == -1 || surfaceCol == -1)
+  {
+    fclose(rwy);
+    return false;
+  }
+
+  while (readCsvRecord(rwy, record))
+  {
+    splitCsvRecord(record, fields);
+
+    if (atoi(field(fields, closedCol)) != 0)
+      continue;
+
+    if (filter.accepts(atof(field(fields, lengthCol)), classifyRunwaySurface(field(fields, surfaceCol))))
+      runways.insert(field(fields, airportCol));
+  }
+
+  fclose(rwy);
+  haveRunways = true;
+
+  return true;
+}
+
+bool AirportCsvImporter::open(const char *_path)
+{
+  close();
+
+  haveRunways = false;
+
+  if (!runwaysPath.empty() && !loadRunways())
+    return false;
+
+  in = fopen(_path, "r");
+
+  if (in == nullptr)
+    return false;
+
+  if (!readCsvRecord(in, record))
+  {
+    close();
+    return false;
+  }
+
+  splitCsvRecord(record, fields);
+  identCol = findColumn(fields, identColumns, COUNTOF(identColumns));
+  latCol = findColumn(fields, latColumns, COUNTOF(latColumns));
+  lonCol = findColumn(fields, lonColumns, COUNTOF(lonColumns));
+  elevCol = findColumn(fields, elevColumns, COUNTOF(elevColumns));
+  typeCol = findColumn(fields, typeColumns, COUNTOF(typeColumns));
+
+  if (identCol == -1 || latCol == -1 || lonCol == -1)
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+int AirportCsvImporter::next(ImportRow &_row)
+{
+  const char *ident, *type;
+  size_t i;
+
+  if (in == nullptr)
+    return -1;
+
+  while (readCsvRecord(in, record))
+  {
+    splitCsvRecord(record, fields);
+
+    ident = field(fields, identCol);
+    type = field(fields, typeCol);
+
+    if (*ident == 0 || *field(fields, latCol) == 0 || *field(fields, lonCol) == 0)
+      continue;
+
+    for (i = 0; i < COUNTOF(rejectedTypes); ++i)
+    {
+      if (strcmp(type, rejectedTypes[i]) == 0)
+        break;
+    }
+
+    if (i < COUNTOF(rejectedTypes) || (haveRunways && runways.count(ident) == 0))
+    {
+      ++rejectCount;
+      continue;
+    }
+
+    memset(&_row, 0, sizeof(_row));
+    strncpy(_row.ident, ident, sizeof(_row.ident) - 1);
+    _row.lat = atof(field(fields, latCol));
+    _row.lon = atof(field(fields, lonCol));
+    _row.elev = atof(field(fields, elevCol));
+
+    return 1;
+  }
+
+  return (ferror(in) ? -1 : 0);
+}
@@ -0,0 +1,179 @@
+#ifndef RecoveryImporter_hpp
+#define RecoveryImporter_hpp
+
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * One recovery location read from an input file, ready for a RecoveryWriter.
+ */
+struct ImportRow
+{
+  char ident[32];
+  double lat;             // degrees
+  double lon;             // degrees
+  double elev;            // feet
+};
+
+/**
+ * Runway surface classes. Each source's surface codes are folded into these so
+ * that one filter works for every input format.
+ */
+enum RunwaySurface
+{
+  surfPaved   = 0x01,
+  surfGrass   = 0x02,
+  surfDirt    = 0x04,
+  surfGravel  = 0x08,
+  surfSnow    = 0x10,
+  surfWater   = 0x20,
+  surfOther   = 0x40,
+  surfAll     = 0x7f,
+  surfLand    = surfAll & ~surfWater
+};
+
+/**
+ * Build-time runway filter. An airport is kept if at least one of its runways
+ * is at least `minLength' feet long and has one of the `surfaces'.
+ */
+struct RunwayFilter
+{
+  double minLength;       // feet
+  unsigned int surfaces;  // RunwaySurface bits
+
+  bool accepts(double _length, unsigned int _surface) const;
+};
+
+/**
+ * Parses a comma-separated list of surface names (paved, grass, dirt, gravel,
+ * snow, water, other) into RunwaySurface bits.
+ */
+bool parseRunwaySurfaces(const char *_list, unsigned int &_surfaces);
+
+/**
+ * Classifies a free-form surface description, e.g. `ASPH', `Turf', or
+ * `GRVL-G', as used by OurAirports and the FAA.
+ */
+unsigned int classifyRunwaySurface(const char *_surface);
+
+/**
+ * The RecoveryImporter class establishes an interface used by rdbtool to read
+ * recovery locations from a source file one at a time. Importers read their
+ * input as a stream and hold at most one airport at a time. The one exception
+ * is AirportCsvImporter given a runway file; see below.
+ *
+ * next() returns 1 and fills in _row for each location, 0 at the end of the
+ * input, or -1 on a read error. Airports removed by the runway filter, and
+ * heliports, seaplane bases, and the like, are counted by rejected().
+ */
+class RecoveryImporter
+{
+public:
+  RecoveryImporter(const RunwayFilter &_filter);
+
+public:
+  virtual ~RecoveryImporter();
+
+public:
+  virtual bool open(const char *_path) = 0;
+
+  virtual int next(ImportRow &_row) = 0;
+
+  size_t rejected() const;
+
+protected:
+  RunwayFilter filter;
+  size_t rejectCount;
+};
+
+/**
+ * AptDatImporter reads X-Plane apt.dat files. Land airports (row code 1) are
+ * placed at the midpoint of their longest runway that passes the filter;
+ * seaplane bases and heliports are rejected.
+ */
+class AptDatImporter : public RecoveryImporter
+{
+public:
+  AptDatImporter(const RunwayFilter &_filter);
+
+public:
+  virtual ~AptDatImporter();
+
+public:
+  virtual bool open(const char *_path);
+
+  virtual int next(ImportRow &_row);
+
+private:
+  struct Airport
+  {
+    bool active;
+    bool land;
+    ImportRow row;
+    double bestLength;
+  };
+
+private:
+  void close();
+
+  bool finishAirport(ImportRow &_row);
+
+  void startAirport(int _code, const char *_line);
+
+  void addRunway(const char *_line);
+
+private:
+  FILE *in;
+  char *line;
+  size_t lineCap;
+  bool atEnd;
+  Airport airport;
+};
+
+/**
+ * AirportCsvImporter reads an airport CSV with a header row, finding columns
+ * by name. Both the OurAirports airports.csv/runways.csv pair and the FAA
+ * NASR APT_BASE.csv/APT_RWY.csv pair are recognized.
+ *
+ * The runway file is optional. When given, it is streamed first and the
+ * idents of airports with a suitable runway are kept in a set, so memory is
+ * not constant: it grows with the number of suitable airports, a few MB for
+ * the whole OurAirports database. Merging the two files as streams would need
+ * both sorted by airport ident, which neither source guarantees. Without a
+ * runway file, airports are filtered by type only and memory is constant.
+ */
+class AirportCsvImporter : public RecoveryImporter
+{
+public:
+  AirportCsvImporter(const RunwayFilter &_filter, const char *_runwaysPath = nullptr);
+
+public:
+  virtual ~AirportCsvImporter();
+
+public:
+  virtual bool open(const char *_path);
+
+  virtual int next(ImportRow &_row);
+
+private:
+  void close();
+
+  bool loadRunways();
+
+private:
+  std::string runwaysPath;
+  FILE *in;
+  std::string record;
+  std::vector<std::string> fields;
+  int identCol;
+  int latCol;
+  int lonCol;
+  int elevCol;
+  int typeCol;
+  bool haveRunways;
+  std::set<std::string> runways;
+};
+
+#endif
@@ -0,0 +1,842 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sqlite3.h>
+#ifndef NO_SPATIALITE
+#include <spatialite.h>
+#endif
+#include <Utilities.hpp>
+#include "RecoveryWriter.hpp"
+
+using namespace std;
+
+static bool writeAll(int _fd, const void *_buf, size_t _len)
+{
+  const char *p = (const char*)_buf;
+  ssize_t ret;
+
+  while (_len > 0)
+  {
+    ret = write(_fd, p, _len);
+
+    if (ret < 0)
+      return false;
+
+    p += ret;
+    _len -= (size_t)ret;
+  }
+
+  return true;
+}
+
+/**
+ * Set up a new database for one large insert transaction. Nothing else has
+ * the database open and a half-built database is discarded anyway, so skip
+ * the rollback journal and fsyncs and give SQLite a generous page cache.
+ */
+static int beginBulkLoad(sqlite3 *_db)
+{
+  return sqlite3_exec(
+   _db,
+   "PRAGMA journal_mode = OFF; "
+   "PRAGMA synchronous = OFF; "
+   "PRAGMA locking_mode = EXCLUSIVE; "
+   "PRAGMA temp_store = MEMORY; "
+   "PRAGMA cache_size = -65536; "
+   "BEGIN TRANSACTION",
+   0,
+   0,
+   0);
+}
+
+/**
+ * Put a position in the range every backend stores: latitude clamped to the
+ * poles and longitude in [-180, 180).
+ */
+static void normalizePosition(double &_lat, double &_lon)
+{
+  _lat = ::clamp(_lat, -90.0, 90.0);
+  _lon = fmod(fmod(_lon + 180.0, 360.0) + 360.0, 360.0) - 180.0;
+}
+
+static void finalizeStatement(void *&_stmt)
+{
+  if (_stmt != nullptr)
+    sqlite3_finalize((sqlite3_stmt*)_stmt);
+
+  _stmt = nullptr;
+}
+
+static bool prepareStatement(void *_db, const char *_sql, void *&_stmt)
+{
+  sqlite3_stmt *s = nullptr;
+
+  if (sqlite3_prepare_v2((sqlite3*)_db, _sql, -1, &s, 0) != SQLITE_OK)
+    return false;
+
+  _stmt = s;
+
+  return true;
+}
+
+RecoveryWriter::RecoveryWriter()
+{
+
+}
+
+RecoveryWriter::~RecoveryWriter()
+{
+
+}
+
+bool RecoveryWriter::openExisting(const char *_path)
+{
+  return false;
+}
+
+bool RecoveryWriter::getLocations(vector<StoredLocation> &_locs)
+{
+  return false;
+}
+
+bool RecoveryWriter::updateLocation(int64_t _id, double _lat, double _lon, double _elev)
+{
+  return false;
+}
+
+bool RecoveryWriter::deleteLocation(int64_t _id)
+{
+  return false;
+}
+
+#ifndef NO_SPATIALITE
+SpatiaLiteWriter::SpatiaLiteWriter()
+: dbhandle(nullptr),
+  cache(nullptr),
+  stmt(nullptr),
+  updateStmt(nullptr),
+  deleteStmt(nullptr)
+{
+
+}
+
+SpatiaLiteWriter::~SpatiaLiteWriter()
+{
+  close();
+}
+
+bool SpatiaLiteWriter::create(const char *_path)
+{
+  sqlite3 *db = nullptr;
+  sqlite3_stmt *s = nullptr;
+  int ret;
+
+  close();
+
+  try
+  {
+    ret = sqlite3_open_v2(
+     _path,
+     &db,
+     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_EXCLUSIVE,
+     0);
+
+    dbhandle = db;
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    cache = spatialite_alloc_connection();
+    spatialite_init_ex(db, cache, 0);
+
+    ret = sqlite3_exec(
+     db,
+     "SELECT InitSpatialMetadata(1)",
+     0,
+     0,
+     0);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    ret = sqlite3_exec(
+     db,
+     "CREATE TABLE Recovery( "
+     " pkid INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
+     " ident TEXT NOT NULL, "
+     " elev DOUBLE DEFAULT 0);",
+     0,
+     0,
+     0);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    ret = sqlite3_exec(
+     db,
+     "SELECT AddGeometryColumn('Recovery', 'location', 4326, 'POINT', 'XY', 0)",
+     0,
+     0,
+     0);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    ret = sqlite3_exec(
+     db,
+     "SELECT CreateMbrCache('Recovery', 'location')",
+     0,
+     0,
+     0);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    ret = beginBulkLoad(db);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    ret = sqlite3_prepare(
+     db,
+     "INSERT INTO Recovery(ident, elev, location) VALUES(?, ?, ?)",
+     -1,
+     &s,
+     0);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    stmt = s;
+  }
+  catch (int)
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool SpatiaLiteWriter::addLocation(const char *_ident, double _lat, double _lon, double _elev)
+{
+  sqlite3_stmt *s = (sqlite3_stmt*)stmt;
+  unsigned char *ptBlob;
+  int ptSize, ret;
+
+  if (s == nullptr)
+    return false;
+
+  sqlite3_reset(s);
+  sqlite3_clear_bindings(s);
+
+  gaiaMakePoint(_lon, _lat, 4326, &ptBlob, &ptSize);
+
+  if (_ident[0] != 0)
+    sqlite3_bind_text(s, 1, _ident, -1, 0);
+
+  sqlite3_bind_double(s, 2, _elev);
+  sqlite3_bind_blob(s, 3, ptBlob, ptSize, free);
+
+  ret = sqlite3_step(s);
+
+  return (ret == SQLITE_DONE || ret == SQLITE_ROW);
+}
+
+bool SpatiaLiteWriter::finish()
+{
+  bool ok = (stmt != nullptr);
+
+  if (ok)
+  {
+    finalizeStatement(stmt);
+    finalizeStatement(updateStmt);
+    finalizeStatement(deleteStmt);
+    ok = (sqlite3_exec((sqlite3*)dbhandle, "COMMIT", 0, 0, 0) == SQLITE_OK);
+  }
+
+  close();
+
+  return ok;
+}
+
+bool SpatiaLiteWriter::openExisting(const char *_path)
+{
+  sqlite3 *db = nullptr;
+  int ret;
+
+  close();
+
+  try
+  {
+    ret = sqlite3_open_v2(_path, &db, SQLITE_OPEN_READWRITE, 0);
+    dbhandle = db;
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    cache = spatialite_alloc_connection();
+    spatialite_init_ex(db, cache, 0);
+
+    // Readers may have the database open; keep the journal on.
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION", 0, 0, 0) != SQLITE_OK)
+      throw -1;
+
+    if (!prepareStatement(db, "INSERT INTO Recovery(ident, elev, location) VALUES(?, ?, ?)", stmt) ||
+        !prepareStatement(db, "UPDATE Recovery SET elev = ?1, location = ?2 WHERE pkid = ?3", updateStmt) ||
+        !prepareStatement(db, "DELETE FROM Recovery WHERE pkid = ?1", deleteStmt))
+      throw -1;
+  }
+  catch (int)
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool SpatiaLiteWriter::getLocations(vector<StoredLocation> &_locs)
+{
+  StoredLocation loc;
+  void *s = nullptr;
+  int ret;
+
+  if (dbhandle == nullptr ||
+      !prepareStatement(dbhandle, "SELECT pkid, ident, elev, Y(location), X(location) FROM Recovery", s))
+    return false;
+
+  while ((ret = sqlite3_step((sqlite3_stmt*)s)) == SQLITE_ROW)
+  {
+    loc.id = sqlite3_column_int64((sqlite3_stmt*)s, 0);
+    loc.ident = (const char*)sqlite3_column_text((sqlite3_stmt*)s, 1);
+    loc.elev = sqlite3_column_double((sqlite3_stmt*)s, 2);
+    loc.lat = sqlite3_column_double((sqlite3_stmt*)s, 3);
+    loc.lon = sqlite3_column_double((sqlite3_stmt*)s, 4);
+    _locs.push_back(loc);
+  }
+
+  finalizeStatement(s);
+
+  return (ret == SQLITE_DONE);
+}
+
+bool SpatiaLiteWriter::updateLocation(int64_t _id, double _lat, double _lon, double _elev)
+{
+  sqlite3_stmt *s = (sqlite3_stmt*)updateStmt;
+  unsigned char *ptBlob;
+  int ptSize;
+
+  if (s == nullptr)
+    return false;
+
+  sqlite3_reset(s);
+  gaiaMakePoint(_lon, _lat, 4326, &ptBlob, &ptSize);
+  sqlite3_bind_double(s, 1, _elev);
+  sqlite3_bind_blob(s, 2, ptBlob, ptSize, free);
+  sqlite3_bind_int64(s, 3, _id);
+
+  return (sqlite3_step(s) == SQLITE_DONE);
+}
+
+bool SpatiaLiteWriter::deleteLocation(int64_t _id)
+{
+  sqlite3_stmt *s = (sqlite3_stmt*)deleteStmt;
+
+  if (s == nullptr)
+    return false;
+
+  sqlite3_reset(s);
+  sqlite3_bind_int64(s, 1, _id);
+
+  return (sqlite3_step(s) == SQLITE_DONE);
+}
+
+void SpatiaLiteWriter::close()
+{
+  finalizeStatement(stmt);
+  finalizeStatement(updateStmt);
+  finalizeStatement(deleteStmt);
+
+  if (dbhandle != nullptr)
+    sqlite3_close((sqlite3*)dbhandle);
+
+  if (cache != nullptr)
+  {
+    spatialite_cleanup_ex(cache);
+    spatialite_shutdown();
+  }
+
+  dbhandle = nullptr;
+  cache = nullptr;
+}
+#endif
+
+RTreeWriter::RTreeWriter()
+: dbhandle(nullptr),
+  stmt(nullptr),
+  rtreeStmt(nullptr),
+  updateStmt(nullptr),
+  rtreeUpdateStmt(nullptr),
+  deleteStmt(nullptr),
+  rtreeDeleteStmt(nullptr)
+{
+
+}
+
+RTreeWriter::~RTreeWriter()
+{
+  close();
+}
+
+bool RTreeWriter::create(const char *_path)
+{
+  sqlite3 *db = nullptr;
+  int ret;
+
+  close();
+
+  try
+  {
+    ret = sqlite3_open_v2(
+     _path,
+     &db,
+     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_EXCLUSIVE,
+     0);
+
+    dbhandle = db;
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    ret = sqlite3_exec(
+     db,
+     RECOVERY_TABLE_SCHEMA,
+     0,
+     0,
+     0);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    ret = beginBulkLoad(db);
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    if (!prepare())
+      throw -1;
+  }
+  catch (int)
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool RTreeWriter::addLocation(const char *_ident, double _lat, double _lon, double _elev)
+{
+  sqlite3_stmt *s = (sqlite3_stmt*)stmt, *r = (sqlite3_stmt*)rtreeStmt;
+  double lat, lon;
+  int ret;
+
+  if (s == nullptr || _ident[0] == 0)
+    return false;
+
+  lat = _lat;
+  lon = _lon;
+  normalizePosition(lat, lon);
+
+  sqlite3_reset(s);
+  sqlite3_bind_text(s, 1, _ident, -1, SQLITE_TRANSIENT);
+  sqlite3_bind_double(s, 2, _elev);
+  sqlite3_bind_double(s, 3, lat);
+  sqlite3_bind_double(s, 4, lon);
+
+  ret = sqlite3_step(s);
+
+  if (ret != SQLITE_DONE)
+    return false;
+
+  sqlite3_reset(r);
+  sqlite3_bind_int64(r, 1, sqlite3_last_insert_rowid((sqlite3*)dbhandle));
+  sqlite3_bind_double(r, 2, lat);
+  sqlite3_bind_double(r, 3, lon);
+
+  return (sqlite3_step(r) == SQLITE_DONE);
+}
+
+bool RTreeWriter::finish()
+{
+  bool ok = (stmt != nullptr);
+
+  if (ok)
+  {
+    finalizeStatement(stmt);
+    finalizeStatement(rtreeStmt);
+    finalizeStatement(updateStmt);
+    finalizeStatement(rtreeUpdateStmt);
+    finalizeStatement(deleteStmt);
+    finalizeStatement(rtreeDeleteStmt);
+    ok = (sqlite3_exec((sqlite3*)dbhandle, "COMMIT", 0, 0, 0) == SQLITE_OK);
+  }
+
+  close();
+
+  return ok;
+}
+
+bool RTreeWriter::openExisting(const char *_path)
+{
+  sqlite3 *db = nullptr;
+  int ret;
+
+  close();
+
+  try
+  {
+    ret = sqlite3_open_v2(_path, &db, SQLITE_OPEN_READWRITE, 0);
+    dbhandle = db;
+
+    if (ret != SQLITE_OK)
+      throw ret;
+
+    // Readers may have the database open; keep the journal on.
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION", 0, 0, 0) != SQLITE_OK)
+      throw -1;
+
+    if (!prepare() ||
+        !prepareStatement(db, "UPDATE Recovery SET elev = ?1, lat = ?2, lon = ?3 WHERE pkid = ?4", updateStmt) ||
+        !prepareStatement(db, "UPDATE RecoveryRTree SET minLat = ?2, maxLat = ?2, minLon = ?3, maxLon = ?3 WHERE id = ?1", rtreeUpdateStmt) ||
+        !prepareStatement(db, "DELETE FROM Recovery WHERE pkid = ?1", deleteStmt) ||
+        !prepareStatement(db, "DELETE FROM RecoveryRTree WHERE id = ?1", rtreeDeleteStmt))
+      throw -1;
+  }
+  catch (int)
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool RTreeWriter::getLocations(vector<StoredLocation> &_locs)
+{
+  StoredLocation loc;
+  void *s = nullptr;
+  int ret;
+
+  if (dbhandle == nullptr || !prepareStatement(dbhandle, "SELECT pkid, ident, elev, lat, lon FROM Recovery", s))
+    return false;
+
+  while ((ret = sqlite3_step((sqlite3_stmt*)s)) == SQLITE_ROW)
+  {
+    loc.id = sqlite3_column_int64((sqlite3_stmt*)s, 0);
+    loc.ident = (const char*)sqlite3_column_text((sqlite3_stmt*)s, 1);
+    loc.elev = sqlite3_column_double((sqlite3_stmt*)s, 2);
+    loc.lat = sqlite3_column_double((sqlite3_stmt*)s, 3);
+    loc.lon = sqlite3_column_double((sqlite3_stmt*)s, 4);
+    _locs.push_back(loc);
+  }
+
+  finalizeStatement(s);
+
+  return (ret == SQLITE_DONE);
+}
+
+bool RTreeWriter::updateLocation(int64_t _id, double _lat, double _lon, double _elev)
+{
+  sqlite3_stmt *s = (sqlite3_stmt*)updateStmt, *r = (sqlite3_stmt*)rtreeUpdateStmt;
+
+  if (s == nullptr)
+    return false;
+
+  normalizePosition(_lat, _lon);
+
+  sqlite3_reset(s);
+  sqlite3_bind_double(s, 1, _elev);
+  sqlite3_bind_double(s, 2, _lat);
+  sqlite3_bind_double(s, 3, _lon);
+  sqlite3_bind_int64(s, 4, _id);
+
+  if (sqlite3_step(s) != SQLITE_DONE)
+    return false;
+
+  sqlite3_reset(r);
+  sqlite3_bind_int64(r, 1, _id);
+  sqlite3_bind_double(r, 2, _lat);
+  sqlite3_bind_double(r, 3, _lon);
+
+  return (sqlite3_step(r) == SQLITE_DONE);
+}
+
+bool RTreeWriter::deleteLocation(int64_t _id)
+{
+  sqlite3_stmt *s = (sqlite3_stmt*)deleteStmt, *r = (sqlite3_stmt*)rtreeDeleteStmt;
+
+  if (s == nullptr)
+    return false;
+
+  sqlite3_reset(s);
+  sqlite3_bind_int64(s, 1, _id);
+
+  if (sqlite3_step(s) != SQLITE_DONE)
+    return false;
+
+  sqlite3_reset(r);
+  sqlite3_bind_int64(r, 1, _id);
+
+  return (sqlite3_step(r) == SQLITE_DONE);
+}
+
+bool RTreeWriter::prepare()
+{
+  return (prepareStatement(dbhandle, "INSERT INTO Recovery(ident, elev, lat, lon) VALUES(?, ?, ?, ?)", stmt) &&
+          prepareStatement(dbhandle,
+                           "INSERT INTO RecoveryRTree(id, minLat, maxLat, minLon, maxLon) VALUES(?1, ?2, ?2, ?3, ?3)",
+                           rtreeStmt));
+}
+
+void RTreeWriter::close()
+{
+  finalizeStatement(stmt);
+  finalizeStatement(rtreeStmt);
+  finalizeStatement(updateStmt);
+  finalizeStatement(rtreeUpdateStmt);
+  finalizeStatement(deleteStmt);
+  finalizeStatement(rtreeDeleteStmt);
+
+  if (dbhandle != nullptr)
+    sqlite3_close((sqlite3*)dbhandle);
+
+  dbhandle = nullptr;
+}
+
+FlatFileWriter::FlatFileWriter(double _cellSize)
+: cellSize(_cellSize),
+  order(RecoveryFile::gridOrder(_cellSize)),
+  fd(-1)
+{
+
+}
+
+FlatFileWriter::~FlatFileWriter()
+{
+  if (fd != -1)
+    ::close(fd);
+}
+
+bool FlatFileWriter::create(const char *_path)
+{
+  if (fd != -1)
+    ::close(fd);
+
+  entries.clear();
+
+  // Match SQLITE_OPEN_EXCLUSIVE; never overwrite an existing database.
+  fd = ::open(_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+  return (fd != -1);
+}
+
+bool FlatFileWriter::addLocation(const char *_ident, double _lat, double _lon, double _elev)
+{
+  Entry e;
+  Loc pos;
+
+  if (fd == -1 || _ident[0] == 0)
+    return false;
+
+  memset(&e, 0, sizeof(e));
+  pos.lat = _lat;
+  pos.lon = _lon;
+  normalizePosition(pos.lat, pos.lon);
+
+  e.key = RecoveryFile::cellKey(pos, cellSize, order);
+  e.rec.id = (int64_t)entries.size() + 1;
+  strncpy(e.rec.ident, _ident, sizeof(e.rec.ident) - 1);
+  e.rec.elev = _elev;
+  e.rec.lat = pos.lat;
+  e.rec.lon = pos.lon;
+  toUnitVector(pos, e.rec.v);
+
+  entries.push_back(e);
+
+  return true;
+}
+
+bool FlatFileWriter::finish()
+{
+  RecoveryFileHeader header;
+  RecoveryFileCell cell;
+  vector<RecoveryFileCell> cells;
+  size_t i;
+  bool ok = true;
+
+  if (fd == -1)
+    return false;
+
+  stable_sort(entries.begin(), entries.end(),
+    [](const Entry &_a, const Entry &_b) { return _a.key < _b.key; });
+
+  for (i = 0; i < entries.size(); ++i)
+  {
+    if (cells.empty() || cells.back().key != entries[i].key)
+    {
+      memset(&cell, 0, sizeof(cell));
+      cell.key = entries[i].key;
+      cell.first = (u_int32_t)i;
+      cells.push_back(cell);
+    }
+
+    cells.back().count++;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RECOVERY_FILE_MAGIC, sizeof(header.magic));
+  header.version = RECOVERY_FILE_VERSION;
+  header.byteOrder = RECOVERY_FILE_BYTE_ORDER;
+  header.cellSize = cellSize;
+  header.gridOrder = order;
+  header.cellCount = (u_int32_t)cells.size();
+  header.recordCount = (u_int32_t)entries.size();
+  header.cellOffset = sizeof(header);
+  header.recordOffset = header.cellOffset + cells.size() * sizeof(RecoveryFileCell);
+
+  ok = ok && writeAll(fd, &header, sizeof(header));
+  ok = ok && writeAll(fd, cells.data(), cells.size() * sizeof(RecoveryFileCell));
+
+  for (i = 0; ok && i < entries.size(); ++i)
+    ok = writeAll(fd, &entries[i].rec, sizeof(RecoveryFileRecord));
+
+  ok = (::close(fd) == 0) && ok;
+  fd = -1;
+  entries.clear();
+
+  return ok;
+}
+
+RecoveryUpdater::RecoveryUpdater(RecoveryWriter *_target)
+: target(_target),
+  insertCount(0),
+  updateCount(0),
+  deleteCount(0),
+  unchangedCount(0)
+{
+
+}
+
+RecoveryUpdater::~RecoveryUpdater()
+{
+  delete target;
+}
+
+bool RecoveryUpdater::create(const char *_path)
+{
+  size_t i;
+
+  stored.clear();
+  byIdent.clear();
+
+  if (!target->openExisting(_path) || !target->getLocations(stored))
+    return false;
+
+  seen.assign(stored.size(), false);
+
+  for (i = 0; i < stored.size(); ++i)
+  {
+    normalizePosition(stored[i].lat, stored[i].lon);
+    byIdent.insert(make_pair(stored[i].ident, i));
+  }
+
+  return true;
+}
+
+bool RecoveryUpdater::addLocation(const char *_ident, double _lat, double _lon, double _elev)
+{
+  multimap<string, size_t>::iterator it, end;
+  double lat = _lat, lon = _lon;
+  size_t match = stored.size();
+  bool same = false;
+
+  normalizePosition(lat, lon);
+
+  /**
+   * Idents are not guaranteed unique, so match against the rows with this
+   * ident that have not been matched yet, preferring an identical one.
+   */
+  for (it = byIdent.lower_bound(_ident), end = byIdent.upper_bound(_ident); it != end && !same; ++it)
+  {
+    const StoredLocation &s = stored[it->second];
+
+    if (seen[it->second])
+      continue;
+
+    same = (s.lat == lat && s.lon == lon && s.elev == _elev);
+
+    if (same || match == stored.size())
+      match = it->second;
+  }
+
+  if (match == stored.size())
+  {
+    ++insertCount;
+    return target->addLocation(_ident, _lat, _lon, _elev);
+  }
+
+  seen[match] = true;
+
+  if (same)
+  {
+    ++unchangedCount;
+    return true;
+  }
+
+  ++updateCount;
+
+  return target->updateLocation(stored[match].id, _lat, _lon, _elev);
+}
+
+bool RecoveryUpdater::finish()
+{
+  size_t i;
+
+  for (i = 0; i < stored.size(); ++i)
+  {
+    if (seen[i])
+      continue;
+
+    if (!target->deleteLocation(stored[i].id))
+      return false;
+
+    ++deleteCount;
+  }
+
+  return target->finish();
+}
+
+size_t RecoveryUpdater::inserted() const
+{
+  return insertCount;
+}
+
+size_t RecoveryUpdater::updated() const
+{
+  return updateCount;
+}
+
+size_t RecoveryUpdater::deleted() const
+{
+  return deleteCount;
+}
+
+size_t RecoveryUpdater::unchanged() const
+{
+  return unchangedCount;
+}
@@ -0,0 +1,216 @@
+#ifndef RecoveryWriter_hpp
+#define RecoveryWriter_hpp
+
+#include <map>
+#include <string>
+#include <vector>
+#include <RecoveryFile.hpp>
+#include <RecoveryTable.hpp>
+
+/**
+ * A row already in a database, as returned by RecoveryWriter::getLocations().
+ */
+struct StoredLocation
+{
+  int64_t id;
+  std::string ident;
+  double lat;
+  double lon;
+  double elev;
+};
+
+/**
+ * The RecoveryWriter class establishes an interface used by rdbtool to write
+ * recovery locations to a new database. create() must succeed before any
+ * locations are added, and finish() must be called to complete the database.
+ *
+ * Formats that can be changed in place also implement openExisting() and the
+ * row-level calls after it; see RecoveryUpdater. The defaults fail.
+ */
+class RecoveryWriter
+{
+public:
+  RecoveryWriter();
+
+public:
+  virtual ~RecoveryWriter();
+
+public:
+  virtual bool create(const char *_path) = 0;
+
+  virtual bool addLocation(const char *_ident, double _lat, double _lon, double _elev) = 0;
+
+  virtual bool finish() = 0;
+
+  virtual bool openExisting(const char *_path);
+
+  virtual bool getLocations(std::vector<StoredLocation> &_locs);
+
+  virtual bool updateLocation(int64_t _id, double _lat, double _lon, double _elev);
+
+  virtual bool deleteLocation(int64_t _id);
+};
+
+#ifndef NO_SPATIALITE
+/**
+ * SpatiaLiteWriter writes the original SpatiaLite database with a POINT
+ * geometry column. All rows are inserted in a single transaction committed by
+ * finish().
+ */
+class SpatiaLiteWriter : public RecoveryWriter
+{
+public:
+  SpatiaLiteWriter();
+
+public:
+  virtual ~SpatiaLiteWriter();
+
+public:
+  virtual bool create(const char *_path);
+
+  virtual bool addLocation(const char *_ident, double _lat, double _lon, double _elev);
+
+  virtual bool finish();
+
+  virtual bool openExisting(const char *_path);
+
+  virtual bool getLocations(std::vector<StoredLocation> &_locs);
+
+  virtual bool updateLocation(int64_t _id, double _lat, double _lon, double _elev);
+
+  virtual bool deleteLocation(int64_t _id);
+
+private:
+  void close();
+
+private:
+  void *dbhandle;
+  void *cache;
+  void *stmt;
+  void *updateStmt;
+  void *deleteStmt;
+};
+#endif
+
+/**
+ * RTreeWriter writes the plain SQLite schema described in RecoveryTable.hpp.
+ * All rows are inserted in a single transaction committed by finish().
+ */
+class RTreeWriter : public RecoveryWriter
+{
+public:
+  RTreeWriter();
+
+public:
+  virtual ~RTreeWriter();
+
+public:
+  virtual bool create(const char *_path);
+
+  virtual bool addLocation(const char *_ident, double _lat, double _lon, double _elev);
+
+  virtual bool finish();
+
+  virtual bool openExisting(const char *_path);
+
+  virtual bool getLocations(std::vector<StoredLocation> &_locs);
+
+  virtual bool updateLocation(int64_t _id, double _lat, double _lon, double _elev);
+
+  virtual bool deleteLocation(int64_t _id);
+
+private:
+  bool prepare();
+
+  void close();
+
+private:
+  void *dbhandle;
+  void *stmt;
+  void *rtreeStmt;
+  void *updateStmt;
+  void *rtreeUpdateStmt;
+  void *deleteStmt;
+  void *rtreeDeleteStmt;
+};
+
+/**
+ * FlatFileWriter writes the memory-mappable format described in
+ * RecoveryFile.hpp. Records are held in memory until finish() so that they can
+ * be sorted along the space-filling curve.
+ */
+class FlatFileWriter : public RecoveryWriter
+{
+public:
+  FlatFileWriter(double _cellSize = RECOVERY_FILE_CELL_SIZE);
+
+public:
+  virtual ~FlatFileWriter();
+
+public:
+  virtual bool create(const char *_path);
+
+  virtual bool addLocation(const char *_ident, double _lat, double _lon, double _elev);
+
+  virtual bool finish();
+
+private:
+  struct Entry
+  {
+    u_int32_t key;
+    RecoveryFileRecord rec;
+  };
+
+private:
+  double cellSize;
+  u_int32_t order;
+  int fd;
+  std::vector<Entry> entries;
+};
+
+/**
+ * RecoveryUpdater brings an existing database in line with a new source by
+ * ident instead of rebuilding it. create() opens the database through the
+ * target writer and reads its rows. Each location added is then matched by
+ * ident: new idents are inserted, moved or re-surveyed ones are updated, and
+ * identical ones are left alone. finish() deletes every row whose ident did
+ * not appear and commits all of the changes in one transaction.
+ *
+ * The target's spatial index is kept current row by row. The updater takes
+ * ownership of the target.
+ */
+class RecoveryUpdater : public RecoveryWriter
+{
+public:
+  RecoveryUpdater(RecoveryWriter *_target);
+
+public:
+  virtual ~RecoveryUpdater();
+
+public:
+  virtual bool create(const char *_path);
+
+  virtual bool addLocation(const char *_ident, double _lat, double _lon, double _elev);
+
+  virtual bool finish();
+
+  size_t inserted() const;
+
+  size_t updated() const;
+
+  size_t deleted() const;
+
+  size_t unchanged() const;
+
+private:
+  RecoveryWriter *target;
+  std::vector<StoredLocation> stored;
+  std::vector<bool> seen;
+  std::multimap<std::string, size_t> byIdent;
+  size_t insertCount;
+  size_t updateCount;
+  size_t deleteCount;
+  size_t unchangedCount;
+};
+
+#endif
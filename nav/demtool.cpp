@@ -0,0 +1,189 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <libgen.h>
+#include <getopt.h>
+#include "Terrain.hpp"
+
+using namespace std;
+
+static const char outputOpt = 'o';
+static const char helpOpt = 'h';
+static const char *shortOpts = "o:h";
+static const struct option longOpts[] = {
+  { "output", required_argument, nullptr, outputOpt },
+  { "help", no_argument, nullptr, helpOpt },
+  { nullptr, 0, nullptr, 0 }
+};
+
+static const double m2ft = 3.28084;
+
+/**
+ * Parse the south-west corner out of an SRTM file name, e.g. N46W117.hgt.
+ */
+static bool _parseTileName(const char *_path, int &_lat, int &_lon)
+{
+  char buf[1024], ns, ew;
+  int lat, lon;
+
+  strncpy(buf, _path, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = 0;
+
+  if (sscanf(basename(buf), "%c%2d%c%3d", &ns, &lat, &ew, &lon) != 4)
+    return false;
+
+  if ((ns != 'N' && ns != 'n' && ns != 'S' && ns != 's') ||
+      (ew != 'E' && ew != 'e' && ew != 'W' && ew != 'w'))
+    return false;
+
+  _lat = (ns == 'S' || ns == 's' ? -lat : lat);
+  _lon = (ew == 'W' || ew == 'w' ? -lon : lon);
+
+  return true;
+}
+
+/**
+ * Convert an SRTM .hgt file, a square array of big-endian 16-bit elevations in
+ * meters, to a terrain tile. GeoTIFF and other formats can be converted to
+ * .hgt with gdal_translate -of SRTMHGT first.
+ */
+static int _convertTile(const char *_path, const string &_outDir)
+{
+  vector<unsigned char> raw;
+  vector<int16_t> samples;
+  TerrainTileHeader header;
+  FILE *in, *out;
+  char name[32];
+  string outPath;
+  long size;
+  size_t n, i;
+  int lat, lon, v;
+  bool ok;
+
+  if (!_parseTileName(_path, lat, lon))
+  {
+    cerr << "Cannot determine the tile location of `" << _path << "'." << endl;
+    return -1;
+  }
+
+  in = fopen(_path, "rb");
+
+  if (in == nullptr)
+  {
+    cerr << "Failed to open `" << _path << "'." << endl;
+    return -1;
+  }
+
+  fseek(in, 0, SEEK_END);
+  size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+
+  n = (size_t)sqrt((double)size / 2.0);
+
+  if (n < 2 || n * n * 2 != (size_t)size)
+  {
+    cerr << "`" << _path << "' is not an SRTM tile." << endl;
+    fclose(in);
+    return -1;
+  }
+
+  raw.resize((size_t)size);
+  ok = (fread(raw.data(), 1, raw.size(), in) == raw.size());
+  fclose(in);
+
+  if (!ok)
+  {
+    cerr << "Failed to read `" << _path << "'." << endl;
+    return -1;
+  }
+
+  samples.resize(n * n);
+
+  for (i = 0; i < samples.size(); ++i)
+  {
+    v = (int16_t)((raw[i * 2] << 8) | raw[i * 2 + 1]);
+    samples[i] = (v == TERRAIN_TILE_VOID ? TERRAIN_TILE_VOID : (int16_t)lround(v * m2ft));
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TERRAIN_TILE_MAGIC, sizeof(header.magic));
+  header.version = TERRAIN_TILE_VERSION;
+  header.byteOrder = TERRAIN_TILE_BYTE_ORDER;
+  header.lat = lat;
+  header.lon = lon;
+  header.rows = (u_int32_t)n;
+  header.cols = (u_int32_t)n;
+
+  Terrain::tileName(lat, lon, name, sizeof(name));
+  outPath = _outDir + name;
+
+  out = fopen(outPath.c_str(), "wb");
+
+  if (out == nullptr)
+  {
+    cerr << "Failed to create `" << outPath << "'." << endl;
+    return -1;
+  }
+
+  ok = (fwrite(&header, sizeof(header), 1, out) == 1);
+  ok = ok && (fwrite(samples.data(), sizeof(int16_t), samples.size(), out) == samples.size());
+  ok = (fclose(out) == 0) && ok;
+
+  if (!ok)
+  {
+    cerr << "Failed to write `" << outPath << "'." << endl;
+    remove(outPath.c_str());
+    return -1;
+  }
+
+  cout << _path << " -> " << outPath << endl;
+
+  return 0;
+}
+
+static void _usage()
+{
+  cerr << endl << "Usage: demtool [options] <SRTM .hgt file>..." << endl << endl;
+  cerr << "  -o, --output <dir>   Write terrain tiles to <dir> (default: .)." << endl;
+  cerr << "  -h, --help           Print this message." << endl << endl;
+}
+
+int main(int _argc, char* _argv[])
+{
+  string outDir = "./";
+  int c, i, ret = 0;
+
+  while ((c = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (c)
+    {
+    case outputOpt:
+      outDir = optarg;
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  if (optind >= _argc)
+  {
+    _usage();
+    return -1;
+  }
+
+  if (!outDir.empty() && outDir.back() != '/')
+    outDir.push_back('/');
+
+  for (i = optind; i < _argc; ++i)
+  {
+    if (_convertTile(_argv[i], outDir) != 0)
+      ret = -1;
+  }
+
+  return ret;
+}
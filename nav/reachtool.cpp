@@ -0,0 +1,370 @@
+#include <unistd.h>
+#include <pthread.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <GISDatabase.hpp>
+#include <ReachGrid.hpp>
+#include <Terrain.hpp>
+
+using namespace std;
+
+static const char boxOpt = 'b';
+static const char terrainOpt = 't';
+static const char glideRatioOpt = 'g';
+static const char cellSizeOpt = 'c';
+static const char maxDistanceOpt = 'm';
+static const char threadsOpt = 'j';
+static const char helpOpt = 'h';
+static const char *shortOpts = "b:t:g:c:m:j:h";
+static const struct option longOpts[] = {
+  { "box", required_argument, nullptr, boxOpt },
+  { "terrain", required_argument, nullptr, terrainOpt },
+  { "glide-ratio", required_argument, nullptr, glideRatioOpt },
+  { "cell-size", required_argument, nullptr, cellSizeOpt },
+  { "max-distance", required_argument, nullptr, maxDistanceOpt },
+  { "threads", required_argument, nullptr, threadsOpt },
+  { "help", no_argument, nullptr, helpOpt },
+  { nullptr, 0, nullptr, 0 }
+};
+
+static const double nm2ft = 6076.12;
+
+struct GridCell
+{
+  float alt;
+  RecoveryLocation loc;
+};
+
+struct GridJob
+{
+  GISDatabase *db;
+  const char *terrainPath;
+  double glideRatio;
+  double maxDistance;
+  double south;
+  double west;
+  double cellSize;
+  u_int32_t rows;
+  u_int32_t cols;
+  long nextRow;
+  long rowsDone;
+  vector<GridCell> *cells;
+};
+
+struct Reach
+{
+  double bound;
+  double dis;
+  size_t i;
+};
+
+/**
+ * Find the recovery location needing the least altitude from the centre of a
+ * cell. The altitude must cover both the glide to the location's elevation
+ * and every terrain sample along the way. Locations are tried in order of the
+ * terrain-free bound so that the terrain check stops as soon as no remaining
+ * location can do better.
+ */
+static void _computeCell(GISDatabase *_db, Terrain *_terrain, const GridJob *_job, const Loc &_center, double _slack, GridCell &_cell)
+{
+  vector<RecoveryLocation> locs;
+  vector<Reach> order;
+  Reach r;
+  double best = DBL_MAX, dis, brg, need, cl;
+  size_t i;
+
+  _cell.alt = FLT_MAX;
+  _cell.loc.id = -1;
+
+  _db->getLocationsWithin(_center, _job->maxDistance, locs);
+
+  for (i = 0; i < locs.size(); ++i)
+  {
+    getDistanceAndBearing(_center, locs[i].pos, dis, brg);
+
+    if (dis > _job->maxDistance)
+      continue;
+
+    r.bound = locs[i].elev + dis * nm2ft / _job->glideRatio;
+    r.dis = dis;
+    r.i = i;
+    order.push_back(r);
+  }
+
+  sort(order.begin(), order.end(), [](const Reach &_a, const Reach &_b) { return _a.bound < _b.bound; });
+
+  for (i = 0; i < order.size() && order[i].bound < best; ++i)
+  {
+    const RecoveryLocation &loc = locs[order[i].i];
+
+    need = order[i].bound;
+
+    // The clearance of a glide line starting at 0 ft is minus the least
+    // starting altitude that clears every terrain sample.
+    if (_terrain != nullptr &&
+        _terrain->getMinClearance(_center, 0.0, loc.pos, -order[i].dis * nm2ft / _job->glideRatio, cl))
+      need = max(need, -cl);
+
+    if (need < best)
+    {
+      best = need;
+      _cell.loc = loc;
+    }
+  }
+
+  if (_cell.loc.id != -1)
+    _cell.alt = (float)(best + _slack);
+}
+
+static void* _gridThreadProc(void *_ptr)
+{
+  GridJob *job = static_cast<GridJob*>(_ptr);
+  Terrain *terrain = nullptr;
+  double slack, halfDiag;
+  long row;
+  u_int32_t col;
+  Loc center;
+
+  if (job->terrainPath != nullptr)
+    terrain = new Terrain(job->terrainPath);
+
+  /**
+   * The cell value must hold anywhere in the cell, not just at its centre, so
+   * add the altitude needed to glide across half of the cell's diagonal.
+   */
+  halfDiag = job->cellSize * 60.0 * sqrt(2.0) / 2.0;
+  slack = halfDiag * nm2ft / job->glideRatio;
+
+  while ((row = __sync_fetch_and_add(&job->nextRow, 1)) < (long)job->rows)
+  {
+    center.lat = job->south + (row + 0.5) * job->cellSize;
+
+    for (col = 0; col < job->cols; ++col)
+    {
+      center.lon = job->west + (col + 0.5) * job->cellSize;
+      _computeCell(job->db, terrain, job, center, slack, (*job->cells)[(size_t)row * job->cols + col]);
+    }
+
+    __sync_fetch_and_add(&job->rowsDone, 1);
+  }
+
+  delete terrain;
+
+  return nullptr;
+}
+
+static int _writeGrid(const char *_path, const GridJob &_job)
+{
+  ReachGridHeader header;
+  ReachGridSite site;
+  ReachGridCell empty, cell;
+  vector<ReachGridSite> sites;
+  vector<ReachGridCell> cells;
+  map<int64_t, u_int32_t> siteIndex;
+  map<int64_t, u_int32_t>::iterator s;
+  u_int32_t row, col;
+  FILE *out;
+  bool ok;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, REACH_GRID_MAGIC, sizeof(header.magic));
+  header.version = REACH_GRID_VERSION;
+  header.byteOrder = REACH_GRID_BYTE_ORDER;
+  header.south = _job.south;
+  header.west = _job.west;
+  header.cellSize = _job.cellSize;
+  header.glideRatio = _job.glideRatio;
+  header.rows = _job.rows;
+  header.cols = _job.cols;
+  header.tileSize = REACH_GRID_TILE_SIZE;
+
+  empty.alt = FLT_MAX;
+  empty.site = REACH_GRID_NO_SITE;
+  cells.resize(ReachGrid::cellCount(header), empty);
+
+  for (row = 0; row < _job.rows; ++row)
+  {
+    for (col = 0; col < _job.cols; ++col)
+    {
+      const GridCell &g = (*_job.cells)[(size_t)row * _job.cols + col];
+
+      if (g.loc.id == -1)
+        continue;
+
+      if ((s = siteIndex.find(g.loc.id)) == siteIndex.end())
+      {
+        memset(&site, 0, sizeof(site));
+        site.id = g.loc.id;
+        strncpy(site.ident, g.loc.ident, sizeof(site.ident) - 1);
+        site.elev = g.loc.elev;
+        site.lat = g.loc.pos.lat;
+        site.lon = g.loc.pos.lon;
+        s = siteIndex.insert(make_pair(g.loc.id, (u_int32_t)sites.size())).first;
+        sites.push_back(site);
+      }
+
+      cell.alt = g.alt;
+      cell.site = s->second;
+      cells[ReachGrid::cellIndex(header, row, col)] = cell;
+    }
+  }
+
+  header.siteCount = (u_int32_t)sites.size();
+  header.siteOffset = sizeof(header);
+  header.cellOffset = header.siteOffset + sites.size() * sizeof(ReachGridSite);
+
+  out = fopen(_path, "wb");
+
+  if (out == nullptr)
+  {
+    cerr << "Failed to create `" << _path << "'." << endl;
+    return -1;
+  }
+
+  ok = (fwrite(&header, sizeof(header), 1, out) == 1);
+  ok = ok && (fwrite(sites.data(), sizeof(ReachGridSite), sites.size(), out) == sites.size());
+  ok = ok && (fwrite(cells.data(), sizeof(ReachGridCell), cells.size(), out) == cells.size());
+  ok = (fclose(out) == 0) && ok;
+
+  if (!ok)
+  {
+    cerr << "Failed to write `" << _path << "'." << endl;
+    remove(_path);
+    return -1;
+  }
+
+  cout << "Wrote " << _job.rows << " x " << _job.cols << " cells, " << sites.size() << " site(s)." << endl;
+
+  return 0;
+}
+
+static void _usage()
+{
+  cerr << endl << "Usage: reachtool [options] -b <south,west,north,east> <recovery database> <new grid>" << endl << endl;
+  cerr << "  -b, --box <s,w,n,e>        Grid bounds in degrees." << endl;
+  cerr << "  -t, --terrain <dir>        Terrain tile directory (default: none)." << endl;
+  cerr << "  -g, --glide-ratio <n>      Reference glide ratio (default: 20)." << endl;
+  cerr << "  -c, --cell-size <min>      Cell size in minutes of arc (default: 1)." << endl;
+  cerr << "  -m, --max-distance <nm>    Farthest location to consider (default: 60)." << endl;
+  cerr << "  -j, --threads <n>          Worker threads (default: one per core)." << endl;
+  cerr << "  -h, --help                 Print this message." << endl << endl;
+}
+
+int main(int _argc, char* _argv[])
+{
+  GridJob job;
+  vector<GridCell> cells;
+  vector<pthread_t> threads;
+  double north = 0.0, east = 0.0;
+  bool box = false;
+  long n = sysconf(_SC_NPROCESSORS_ONLN), i;
+  int c;
+
+  memset(&job, 0, sizeof(job));
+  job.glideRatio = 20.0;
+  job.maxDistance = 60.0;
+  job.cellSize = 1.0 / 60.0;
+
+  while ((c = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (c)
+    {
+    case boxOpt:
+      box = (sscanf(optarg, "%lf,%lf,%lf,%lf", &job.south, &job.west, &north, &east) == 4);
+      break;
+    case terrainOpt:
+      job.terrainPath = optarg;
+      break;
+    case glideRatioOpt:
+      job.glideRatio = atof(optarg);
+      break;
+    case cellSizeOpt:
+      job.cellSize = atof(optarg) / 60.0;
+      break;
+    case maxDistanceOpt:
+      job.maxDistance = atof(optarg);
+      break;
+    case threadsOpt:
+      n = atol(optarg);
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  if (_argc - optind < 2 || !box || job.glideRatio <= 0.0 || job.cellSize <= 0.0 || job.maxDistance <= 0.0)
+  {
+    _usage();
+    return -1;
+  }
+
+  if (north <= job.south || east <= job.west)
+  {
+    cerr << "The grid box is empty." << endl;
+    return -1;
+  }
+
+  /**
+   * Every thread queries this one database; queries take no locks. It must
+   * outlive the threads: destroying a GISDatabase shuts SpatiaLite down for
+   * the whole process.
+   */
+  GISDatabase db(_argv[optind]);
+
+  if (!db.isOpen())
+  {
+    cerr << "Failed to open `" << _argv[optind] << "'." << endl;
+    return -1;
+  }
+
+  job.db = &db;
+
+  job.rows = (u_int32_t)ceil((north - job.south) / job.cellSize);
+  job.cols = (u_int32_t)ceil((east - job.west) / job.cellSize);
+  cells.resize((size_t)job.rows * job.cols);
+  job.cells = &cells;
+
+  /**
+   * Rows are handed out one at a time, so the threads stay busy even though
+   * rows over dense areas take longer than rows over empty ones.
+   */
+  n = ::clamp(n, 1L, (long)job.rows);
+  threads.resize((size_t)n);
+
+  for (i = 0; i < n; ++i)
+  {
+    if (pthread_create(&threads[i], nullptr, _gridThreadProc, &job) != 0)
+    {
+      // The running threads use `job' and `cells'; stop them before returning.
+      cerr << "Failed to start worker threads." << endl;
+      __sync_lock_test_and_set(&job.nextRow, (long)job.rows);
+
+      while (i > 0)
+        pthread_join(threads[--i], nullptr);
+
+      return -1;
+    }
+  }
+
+  while (__sync_fetch_and_add(&job.rowsDone, 0) < (long)job.rows)
+  {
+    cout << "\r" << job.rowsDone << "/" << job.rows << " rows" << flush;
+    usleep(500000);
+  }
+
+  cout << "\r" << job.rows << "/" << job.rows << " rows" << endl;
+
+  for (i = 0; i < n; ++i)
+    pthread_join(threads[i], nullptr);
+
+  return _writeGrid(_argv[optind + 1], job);
+}
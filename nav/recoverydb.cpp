@@ -1,9 +1,17 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <iostream>
-#include <string>
-#include <sstream>
+#include <vector>
 #include <ctime>
-#include <sqlite3.h>
-#include <spatialite.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include "RecoveryImporter.hpp"
+#include "RecoveryWriter.hpp"
 
 using namespace std;
 
@@ -15,10 +23,65 @@ struct Coord
   double sec;
 };
 
-struct LatLon
+/**
+ * A slice of the mapped input, always starting at the beginning of a line and
+ * ending just past a newline or at the end of the file.
+ */
+struct ImportChunk
 {
-  Coord lat;
-  Coord lon;
+  const char *begin;
+  const char *end;
+  size_t skipped;
+  vector<ImportRow> rows;
+  pthread_t thread;
+};
+
+/**
+ * Batches passed from a streaming importer's thread to the writer. The batch
+ * count bounds how far parsing can run ahead of inserting, and with it the
+ * memory in use.
+ */
+#define IMPORT_BATCH_ROWS   4096
+#define IMPORT_BATCH_COUNT  4
+
+struct ImportBatch
+{
+  size_t count;
+  ImportRow rows[IMPORT_BATCH_ROWS];
+};
+
+struct ImportPipe
+{
+  RecoveryImporter *importer;
+  ImportBatch batches[IMPORT_BATCH_COUNT];
+  size_t head;            // next batch for the writer
+  size_t filled;          // batches ready for the writer
+  bool done;
+  bool failed;
+  bool cancel;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static const char formatOpt = 'f';
+static const char inputOpt = 'i';
+static const char runwaysOpt = 'R';
+static const char minLengthOpt = 'l';
+static const char surfacesOpt = 's';
+static const char threadsOpt = 'j';
+static const char updateOpt = 'u';
+static const char helpOpt = 'h';
+static const char *shortOpts = "f:i:R:l:s:j:uh";
+static const struct option longOpts[] = {
+  { "format", required_argument, nullptr, formatOpt },
+  { "input", required_argument, nullptr, inputOpt },
+  { "runways", required_argument, nullptr, runwaysOpt },
+  { "min-length", required_argument, nullptr, minLengthOpt },
+  { "surfaces", required_argument, nullptr, surfacesOpt },
+  { "threads", required_argument, nullptr, threadsOpt },
+  { "update", no_argument, nullptr, updateOpt },
+  { "help", no_argument, nullptr, helpOpt },
+  { nullptr, 0, nullptr, 0 }
 };
 
 enum Field
@@ -27,7 +90,8 @@ enum Field
   aptIdent = 0,
   aptLatitude = 1,
   aptLongitude = 2,
-  aptElev = 3
+  aptElev = 3,
+  aptFieldCount = 4
 };
 
 static int _parseCoord(const char *_str, Coord *_coord)
@@ -45,132 +109,176 @@ static int _parseCoord(const char *_str, Coord *_coord)
   return 0;
 }
 
-static int _readRecoveryLocations(const char *_path, sqlite3 *_db)
+static double _toDegrees(const char *_str)
+{
+  Coord c;
+
+  _parseCoord(_str, &c);
+
+  return c.s * (c.deg + c.min / 60.0 + c.sec / 3600.0);
+}
+
+/**
+ * Parse one CSV line. Each field is copied into a NUL-terminated buffer so
+ * that the number parsers never run past the end of the mapped input.
+ */
+static bool _parseLine(const char *_p, const char *_end, ImportRow &_row)
+{
+  char fields[aptFieldCount][32];
+  int field = 0;
+  size_t len = 0;
+
+  for (; _p < _end && *_p != '\n'; ++_p)
+  {
+    if (*_p == ',')
+    {
+      if (field < aptFieldCount)
+        fields[field][len] = 0;
+
+      ++field;
+      len = 0;
+    }
+    else if (*_p != '\r' && field < aptFieldCount && len < sizeof(fields[0]) - 1)
+      fields[field][len++] = *_p;
+  }
+
+  if (field < aptFieldCount)
+    fields[field][len] = 0;
+
+  if (field < aptFieldCount - 1 || fields[aptIdent][0] == 0)
+    return false;
+
+  memcpy(_row.ident, fields[aptIdent], sizeof(_row.ident));
+  _row.lat = _toDegrees(fields[aptLatitude]);
+  _row.lon = _toDegrees(fields[aptLongitude]);
+  _row.elev = strtod(fields[aptElev], nullptr);
+
+  return true;
+}
+
+static void* _parseThreadProc(void *_ptr)
 {
-  FILE *data;
-  char buf[32768];
-  size_t i, j, bytes;
-  stringstream sql;
-  string ident;
-  string lat;
-  string lon;
-  string elev;
-  LatLon latLon;
-  int field = 0, isEOL, isSep, ret, ok = 0;
-  int isFirstLine = 1;
-  double latdd, londd, elevd;
-  unsigned char *ptBlob;
-  int ptSize, recs = 0;
-  sqlite3_stmt *stmt;
-
-  data = fopen(_path, "r");
-
-  if (!data)
+  ImportChunk *chunk = static_cast<ImportChunk*>(_ptr);
+  const char *p = chunk->begin, *eol;
+  ImportRow row;
+
+  while (p < chunk->end)
+  {
+    eol = (const char*)memchr(p, '\n', chunk->end - p);
+
+    if (eol == nullptr)
+      eol = chunk->end;
+
+    if (_parseLine(p, eol, row))
+      chunk->rows.push_back(row);
+    else if (eol > p && !(eol - p == 1 && *p == '\r'))
+      ++chunk->skipped;
+
+    p = eol + 1;
+  }
+
+  return nullptr;
+}
+
+/**
+ * Map the input, split it on line boundaries into one chunk per thread, and
+ * parse the chunks in parallel. The chunks are handed to the writer in file
+ * order as each one finishes, so inserting overlaps with parsing and the rows
+ * keep their order (and their row ids) from the input.
+ */
+static int _readRecoveryLocations(const char *_path, RecoveryWriter *_writer, long _threads)
+{
+  struct timespec start, end;
+  struct stat st;
+  vector<ImportChunk> chunks;
+  const char *data = nullptr, *p, *q, *dataEnd;
+  void *m = MAP_FAILED;
+  size_t recs = 0, skipped = 0, i, j;
+  double secs;
+  int fd, ok = 0;
+  long started = 0, joined = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  fd = open(_path, O_RDONLY);
+
+  if (fd == -1)
     return -1;
 
   try
   {
-    ret = sqlite3_prepare(
-     _db,
-     "INSERT INTO Recovery(ident, elev, location) VALUES(?, ?, ?)",
-     -1,
-     &stmt,
-     0);
+    if (fstat(fd, &st) != 0)
+      throw -1;
+
+    if (st.st_size > 0)
+    {
+      m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (m == MAP_FAILED)
+        throw -1;
 
-    if (ret != SQLITE_OK)
-      throw ret;
+      madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+      data = (const char*)m;
+    }
+
+    dataEnd = data + st.st_size;
+
+    // Skip the header line.
+    p = (data != nullptr ? (const char*)memchr(data, '\n', st.st_size) : nullptr);
+    p = (p != nullptr ? p + 1 : dataEnd);
 
-    for (;;)
+    chunks.resize((size_t)_threads);
+
+    for (i = 0; i < chunks.size(); ++i)
     {
-      bytes = fread(buf, sizeof(char), 32768, data);
+      q = p + (dataEnd - p) / (chunks.size() - i);
 
-      if (bytes == 0)
-        break;
+      if (q < dataEnd && (q = (const char*)memchr(q, '\n', dataEnd - q)) != nullptr)
+        ++q;
+      else
+        q = dataEnd;
 
-      for (i = 0, j = 0; i < bytes; i++)
+      chunks[i].begin = p;
+      chunks[i].end = q;
+      chunks[i].skipped = 0;
+      p = q;
+    }
+
+    for (; started < _threads; ++started)
+    {
+      if (pthread_create(&chunks[started].thread, nullptr, _parseThreadProc, &chunks[started]) != 0)
+        throw -1;
+    }
+
+    for (i = 0; i < chunks.size(); ++i)
+    {
+      pthread_join(chunks[i].thread, nullptr);
+      ++joined;
+
+      for (j = 0; j < chunks[i].rows.size(); ++j)
       {
-        isEOL = (buf[i] == '\n');
-        isSep = (isEOL || buf[i] == ',');
-
-        if (isFirstLine)
-        {
-          if (isEOL)
-          {
-            isFirstLine = 0;
-            j = i + 1;
-          }
-
-          continue;
-        }
-
-        if (isSep || i == bytes - 1)
-        {
-          switch (field)
-          {
-          case aptIdent:
-            ident.append(&buf[j], i - j);
-            break;
-          case aptLatitude:
-            lat.append(&buf[j], i - j);
-            break;
-          case aptLongitude:
-            lon.append(&buf[j], i - j);
-            break;
-          case aptElev:
-            elev.append(&buf[j], i - j);
-            break;
-          }
-
-          j = i + 1;
-
-          if (isSep)
-            field++;
-        }
-
-        if (isEOL)
-        {
-          sqlite3_reset(stmt);
-          sqlite3_clear_bindings(stmt);
-
-          elevd = strtod(elev.c_str(), 0);
-
-          _parseCoord(lat.c_str(), &latLon.lat);
-          latdd = latLon.lat.deg;
-          latdd += latLon.lat.min / 60.0;
-          latdd += latLon.lat.sec / 3600.0;
-          latdd *= latLon.lat.s;
-
-          _parseCoord(lon.c_str(), &latLon.lon);
-          londd = latLon.lon.deg;
-          londd += latLon.lon.min / 60.0;
-          londd += latLon.lon.sec / 3600.0;
-          londd *= latLon.lon.s;
-
-          gaiaMakePoint(londd, latdd, 4326, &ptBlob, &ptSize);
-
-          if (ident.size() > 0)
-            sqlite3_bind_text(stmt, 1, &(*ident.begin()), -1, 0);
-
-          sqlite3_bind_double(stmt, 2, elevd);
-          sqlite3_bind_blob(stmt, 3, ptBlob, ptSize, free);
-
-          ret = sqlite3_step(stmt);
-
-          if (ret != SQLITE_DONE && ret != SQLITE_ROW)
-            throw ret;
-
-          ident.clear();
-          lat.clear();
-          lon.clear();
-          elev.clear();
-          field = 0;
-          j = i + 1;
-          ++recs;
-        }
+        const ImportRow &r = chunks[i].rows[j];
+
+        if (!_writer->addLocation(r.ident, r.lat, r.lon, r.elev))
+          throw -1;
       }
+
+      recs += chunks[i].rows.size();
+      skipped += chunks[i].skipped;
+      vector<ImportRow>().swap(chunks[i].rows);
     }
 
-    cout << "Added " << recs << " record(s) to the recovery database." << endl;
+    if (!_writer->finish())
+      throw -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    cout << "Added " << recs << " record(s) to the recovery database in " << secs << " s ("
+         << (size_t)(recs / (secs > 0.0 ? secs : 1.0)) << " rows/s)." << endl;
+
+    if (skipped > 0)
+      cout << "Skipped " << skipped << " malformed line(s)." << endl;
 
     ok = 1;
   }
@@ -178,10 +286,15 @@ static int _readRecoveryLocations(const char *_path, sqlite3 *_db)
   {
   }
 
-  if (stmt)
-    sqlite3_finalize(stmt);
-  if (data)
-    fclose(data);
+  // Threads still running after an error must finish before the map goes.
+  for (; joined < started; ++joined)
+    pthread_join(chunks[joined].thread, nullptr);
+
+  if (m != MAP_FAILED)
+    munmap(m, (size_t)st.st_size);
+
+  close(fd);
+
   if (ok)
     return 0;
 
@@ -190,89 +303,306 @@ static int _readRecoveryLocations(const char *_path, sqlite3 *_db)
   return -1;
 }
 
-int main(int _argc, char* _argv[])
+static void* _importThreadProc(void *_ptr)
+{
+  ImportPipe *pipe = static_cast<ImportPipe*>(_ptr);
+  ImportBatch *b;
+  size_t tail = 0;
+  int ret = 1;
+
+  while (ret == 1)
+  {
+    pthread_mutex_lock(&pipe->lock);
+
+    while (pipe->filled == IMPORT_BATCH_COUNT && !pipe->cancel)
+      pthread_cond_wait(&pipe->cond, &pipe->lock);
+
+    if (pipe->cancel)
+    {
+      pthread_mutex_unlock(&pipe->lock);
+      break;
+    }
+
+    pthread_mutex_unlock(&pipe->lock);
+
+    // The writer never touches a batch that has not been handed over.
+    b = &pipe->batches[tail];
+
+    for (b->count = 0; b->count < IMPORT_BATCH_ROWS; ++b->count)
+    {
+      if ((ret = pipe->importer->next(b->rows[b->count])) != 1)
+        break;
+    }
+
+    pthread_mutex_lock(&pipe->lock);
+
+    if (b->count > 0)
+    {
+      tail = (tail + 1) % IMPORT_BATCH_COUNT;
+      ++pipe->filled;
+    }
+
+    pipe->done = (ret != 1);
+    pipe->failed = (ret == -1);
+    pthread_cond_signal(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+  }
+
+  return nullptr;
+}
+
+/**
+ * Stream locations from an importer into a writer. The importer runs on its
+ * own thread and hands over fixed-size batches, so parsing overlaps inserting
+ * and memory use stays constant.
+ */
+static int _streamRecoveryLocations(const char *_path, RecoveryImporter *_importer, RecoveryWriter *_writer)
 {
-  int ret, ok = 0;
-  sqlite3 *db = 0;
-  void *cache = 0;
+  struct timespec start, end;
+  ImportPipe *pipe;
+  ImportBatch *b;
+  pthread_t thread;
+  size_t recs = 0, i;
+  double secs;
+  int ok = 0;
 
-  if (_argc < 3)
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (!_importer->open(_path))
+  {
+    cerr << "Failed to read `" << _path << "'." << endl;
+    return -1;
+  }
+
+  pipe = new ImportPipe();
+  pipe->importer = _importer;
+  pipe->head = 0;
+  pipe->filled = 0;
+  pipe->done = false;
+  pipe->failed = false;
+  pipe->cancel = false;
+  pthread_mutex_init(&pipe->lock, nullptr);
+  pthread_cond_init(&pipe->cond, nullptr);
+
+  if (pthread_create(&thread, nullptr, _importThreadProc, pipe) != 0)
   {
-    cerr << endl << "Usage: recoverydb <new database> <input CSV file>" << endl << endl;
+    delete pipe;
     return -1;
   }
 
   try
   {
-    ret = sqlite3_open_v2(
-     _argv[1],
-     &db,
-     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_EXCLUSIVE,
-     0);
-
-    if (ret != SQLITE_OK)
-      throw ret;
-
-    cache = spatialite_alloc_connection();
-    spatialite_init_ex(db, cache, 0);
-
-    ret = sqlite3_exec(
-     db,
-     "SELECT InitSpatialMetadata(1)",
-     0,
-     0,
-     0);
-
-    if (ret != SQLITE_OK)
-      throw ret;
-
-    ret = sqlite3_exec(
-     db,
-     "CREATE TABLE Recovery( "
-     " pkid INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
-     " ident TEXT NOT NULL, "
-     " elev DOUBLE DEFAULT 0);",
-     0,
-     0,
-     0);
-
-    if (ret != SQLITE_OK)
-      throw ret;
-
-    ret = sqlite3_exec(
-     db,
-     "SELECT AddGeometryColumn('Recovery', 'location', 4326, 'POINT', 'XY', 0)",
-     0,
-     0,
-     0);
-
-    if (ret != SQLITE_OK)
-      throw ret;
-
-    ret = sqlite3_exec(
-     db,
-     "SELECT CreateMbrCache('Recovery', 'location')",
-     0,
-     0,
-     0);
-
-    if (ret != SQLITE_OK)
-      throw ret;
-
-    if (_readRecoveryLocations(_argv[2], db) == 0)
-      ok = 1;
+    while (true)
+    {
+      pthread_mutex_lock(&pipe->lock);
+
+      while (pipe->filled == 0 && !pipe->done)
+        pthread_cond_wait(&pipe->cond, &pipe->lock);
+
+      if (pipe->filled == 0)
+      {
+        pthread_mutex_unlock(&pipe->lock);
+        break;
+      }
+
+      b = &pipe->batches[pipe->head];
+      pthread_mutex_unlock(&pipe->lock);
+
+      for (i = 0; i < b->count; ++i)
+      {
+        if (!_writer->addLocation(b->rows[i].ident, b->rows[i].lat, b->rows[i].lon, b->rows[i].elev))
+          throw -1;
+      }
+
+      recs += b->count;
+
+      pthread_mutex_lock(&pipe->lock);
+      pipe->head = (pipe->head + 1) % IMPORT_BATCH_COUNT;
+      --pipe->filled;
+      pthread_cond_signal(&pipe->cond);
+      pthread_mutex_unlock(&pipe->lock);
+    }
+
+    if (pipe->failed || !_writer->finish())
+      throw -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    cout << "Added " << recs << " record(s) to the recovery database in " << secs << " s ("
+         << (size_t)(recs / (secs > 0.0 ? secs : 1.0)) << " rows/s)." << endl;
+    cout << "Rejected " << _importer->rejected() << " airport(s)." << endl;
+
+    ok = 1;
   }
   catch (int)
   {
   }
 
-  if (db)
+  pthread_mutex_lock(&pipe->lock);
+  pipe->cancel = true;
+  pthread_cond_signal(&pipe->cond);
+  pthread_mutex_unlock(&pipe->lock);
+
+  pthread_join(thread, nullptr);
+  pthread_mutex_destroy(&pipe->lock);
+  pthread_cond_destroy(&pipe->cond);
+  delete pipe;
+
+  if (ok)
+    return 0;
+
+  cerr << "Failed to build database." << endl;
+
+  return -1;
+}
+
+#ifdef NO_SPATIALITE
+static const char *defaultFormat = "rtree";
+#else
+static const char *defaultFormat = "spatialite";
+#endif
+
+static void _usage()
+{
+  cerr << endl << "Usage: rdbtool [options] <database> <input file>" << endl << endl;
+  cerr << "  -f, --format <fmt>       Output format: `spatialite', `rtree', or `flat'" << endl;
+  cerr << "                           (default: `" << defaultFormat << "')." << endl;
+  cerr << "  -i, --input <fmt>        Input format: `dms' (default), the Ident,Lat,Lon,Elev" << endl;
+  cerr << "                           CSV in nav/recovery.csv; `aptdat', an X-Plane apt.dat;" << endl;
+  cerr << "                           or `airports', an OurAirports or FAA NASR airport CSV." << endl;
+  cerr << "  -R, --runways <file>     Runway CSV to go with `airports' input." << endl;
+  cerr << "  -l, --min-length <ft>    Keep airports with a runway at least this long." << endl;
+  cerr << "  -s, --surfaces <s,...>   Keep airports with a runway of these surfaces: paved," << endl;
+  cerr << "                           grass, dirt, gravel, snow, water, other (default: all" << endl;
+  cerr << "                           but water)." << endl;
+  cerr << "  -j, --threads <n>        Parser threads for `dms' input (default: one per core)." << endl;
+  cerr << "  -u, --update             Update an existing `spatialite' or `rtree' database in" << endl;
+  cerr << "                           place, matching rows by ident, instead of creating one." << endl;
+  cerr << "  -h, --help               Print this message." << endl << endl;
+}
+
+int main(int _argc, char* _argv[])
+{
+  RecoveryWriter *writer = nullptr;
+  RecoveryUpdater *updater = nullptr;
+  RecoveryImporter *importer = nullptr;
+  RunwayFilter filter;
+  const char *format = defaultFormat, *input = "dms", *runways = nullptr;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  bool update = false;
+  int c, ok = 0;
+
+  filter.minLength = 0.0;
+  filter.surfaces = surfLand;
+
+  // sysconf() returns -1 if it cannot count the processors.
+  if (threads < 1)
+    threads = 1;
+
+  while ((c = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (c)
+    {
+    case formatOpt:
+      format = optarg;
+      break;
+    case inputOpt:
+      input = optarg;
+      break;
+    case runwaysOpt:
+      runways = optarg;
+      break;
+    case minLengthOpt:
+      filter.minLength = atof(optarg);
+      break;
+    case surfacesOpt:
+      if (!parseRunwaySurfaces(optarg, filter.surfaces))
+      {
+        cerr << "Unknown runway surface in `" << optarg << "'." << endl;
+        return -1;
+      }
+      break;
+    case threadsOpt:
+      threads = atol(optarg);
+      break;
+    case updateOpt:
+      update = true;
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  if (_argc - optind < 2 || threads < 1)
+  {
+    _usage();
+    return -1;
+  }
+
+  if (strcmp(input, "aptdat") == 0)
+    importer = new AptDatImporter(filter);
+  else if (strcmp(input, "airports") == 0)
+    importer = new AirportCsvImporter(filter, runways);
+  else if (strcmp(input, "dms") != 0)
+  {
+    cerr << "Unknown input format `" << input << "'." << endl;
+    return -1;
+  }
+
+#ifndef NO_SPATIALITE
+  if (strcmp(format, "spatialite") == 0)
+    writer = new SpatiaLiteWriter();
+  else
+#endif
+  if (strcmp(format, "rtree") == 0)
+    writer = new RTreeWriter();
+  else if (strcmp(format, "flat") == 0)
+    writer = new FlatFileWriter();
+  else
   {
-    sqlite3_close(db);
-    spatialite_cleanup_ex(cache);
-    spatialite_shutdown();
+    cerr << "Unknown database format `" << format << "'." << endl;
+    delete importer;
+    return -1;
   }
 
+  if (update)
+  {
+    /**
+     * A flat file is one sorted block with its index up front, so there is
+     * nothing to gain by patching it. Rebuild it under a new name and rename
+     * it over the old one; hot reload picks up the new file.
+     */
+    if (strcmp(format, "flat") == 0)
+    {
+      cerr << "Flat databases cannot be updated; build a new one and rename it over the old one." << endl;
+      delete importer;
+      delete writer;
+      return -1;
+    }
+
+    updater = new RecoveryUpdater(writer);
+    writer = updater;
+  }
+
+  if (!writer->create(_argv[optind]))
+    cerr << "Failed to " << (update ? "open `" : "create `") << _argv[optind] << "'." << endl;
+  else if (importer != nullptr)
+    ok = (_streamRecoveryLocations(_argv[optind + 1], importer, writer) == 0);
+  else
+    ok = (_readRecoveryLocations(_argv[optind + 1], writer, threads) == 0);
+
+  if (ok && updater != nullptr)
+  {
+    cout << "Inserted " << updater->inserted() << ", updated " << updater->updated() << ", deleted "
+         << updater->deleted() << ", unchanged " << updater->unchanged() << "." << endl;
+  }
+
+  delete importer;
+  delete writer;
+
   if (ok)
     return 0;
 
@@ -16,6 +16,8 @@
 //#define APPLY_MAG_SCALE_CAL
 #define APPLY_GYRO_BIAS_CAL
 #define DELAY 1250 /* 800 Hz */
+#define SENSOR_STATS_WINDOW 800 /* 1 second of IMU samples */
+#define GPS_STATS_WINDOW 60 /* GPS fixes */
 #define RAD2DEGF(_r) ((float)((_r) * 180.0f / M_PI))
 #define DEG2RADF(_d) ((float)((_d) * M_PI / 180.0f))
 
@@ -82,9 +84,15 @@ void* RpiDataSource::threadProc(void *_ptr)
   NMEA::VTG *vtg = NULL;
   DVector m, a, g;
   float q[4], e[3];
+  /**
+   * About 220 KiB of sliding-window storage; it lives on this thread's stack
+   * since nothing else touches it.
+   */
+  ChannelStats<SENSOR_STATS_WINDOW> gStats[3], aStats[3], mStats[3];
+  ChannelStats<GPS_STATS_WINDOW> gsStats;
   timespec tspec;
   int64_t t, r;
-  int fd = -1, sd;
+  int fd = -1, sd, i;
   bool gpsOk = false, magOk = false, imuOk = false;
 
   // Assume wiringPiSetup() has already been called.
@@ -128,6 +136,18 @@ void* RpiDataSource::threadProc(void *_ptr)
     if (!__sync_bool_compare_and_swap(&rds->cancel, 0, 0))
       break;
 
+    if (__sync_bool_compare_and_swap(&rds->statsReset, 1, 0))
+    {
+      for (i = 0; i < 3; ++i)
+      {
+        gStats[i].reset();
+        aStats[i].reset();
+        mStats[i].reset();
+      }
+
+      gsStats.reset();
+    }
+
     if (magOk)
     {
       mag.readMag(m);
@@ -143,6 +163,10 @@ void* RpiDataSource::threadProc(void *_ptr)
       m.y *= rds->mScale.y;
       m.z *= rds->mScale.z;
 #endif
+
+      mStats[0].pushSample(m.x);
+      mStats[1].pushSample(m.y);
+      mStats[2].pushSample(m.z);
     }
 
     if (imuOk)
@@ -155,6 +179,13 @@ void* RpiDataSource::threadProc(void *_ptr)
       g.y -= rds->gBias.y;
       g.z -= rds->gBias.z;
 #endif
+
+      gStats[0].pushSample(g.x);
+      gStats[1].pushSample(g.y);
+      gStats[2].pushSample(g.z);
+      aStats[0].pushSample(a.x);
+      aStats[1].pushSample(a.y);
+      aStats[2].pushSample(a.z);
     }
 
     clock_gettime(CLOCK_MONOTONIC, &tspec);
@@ -224,7 +255,12 @@ void* RpiDataSource::threadProc(void *_ptr)
        * the previous values.
        */
       if (magOk)
+      {
         rds->curRawSample.m = m;
+        mStats[0].summarize(rds->curRawSample.mStats[0]);
+        mStats[1].summarize(rds->curRawSample.mStats[1]);
+        mStats[2].summarize(rds->curRawSample.mStats[2]);
+      }
 
       if (imuOk)
       {
@@ -240,6 +276,12 @@ void* RpiDataSource::threadProc(void *_ptr)
 
         rds->curRawSample.g = g;
         rds->curRawSample.a = a;
+        gStats[0].summarize(rds->curRawSample.gStats[0]);
+        gStats[1].summarize(rds->curRawSample.gStats[1]);
+        gStats[2].summarize(rds->curRawSample.gStats[2]);
+        aStats[0].summarize(rds->curRawSample.aStats[0]);
+        aStats[1].summarize(rds->curRawSample.aStats[1]);
+        aStats[2].summarize(rds->curRawSample.aStats[2]);
 
         rds->curSample.avail |= (DATA_PITCH | DATA_ROLL);
         rds->curSample.pitch = e[1];
@@ -251,6 +293,7 @@ void* RpiDataSource::threadProc(void *_ptr)
         rds->curSample.avail |= (DATA_POS | DATA_ALT);
         rds->curSample.pos.lat = gga->lat / (60.0 * 10000.0);
         rds->curSample.pos.lon = gga->lon / (60.0 * 10000.0);
+        toNVector(rds->curSample.pos, rds->curSample.nv);
         rds->curSample.alt = gga->altMSL * 3.28084; // meters -> feet
         gga->destroy();
         gga = NULL;
@@ -261,6 +304,8 @@ void* RpiDataSource::threadProc(void *_ptr)
         rds->curSample.avail |= (DATA_HDG | DATA_GS);
         rds->curSample.hdg = vtg->magGTK;
         rds->curSample.gs = vtg->ktsGS;
+        gsStats.pushSample(vtg->ktsGS);
+        gsStats.summarize(rds->curRawSample.gsStats);
         vtg->destroy();
         vtg = NULL;
       }
@@ -275,6 +320,7 @@ void* RpiDataSource::threadProc(void *_ptr)
 
 RpiDataSource::RpiDataSource()
 : cancel(0),
+  statsReset(0),
   dataThread(0),
   sampleLock(PTHREAD_MUTEX_INITIALIZER)
 {
@@ -296,6 +342,7 @@ bool RpiDataSource::start(const DVector &_gBias, const DVector &_mBias, const DV
   stop();
 
   memset(&curSample, 0, sizeof(curSample));
+  toNVector(curSample.pos, curSample.nv);
   memset(&curRawSample, 0, sizeof(curRawSample));
   gBias = _gBias;
   mBias = _mBias;
@@ -321,6 +368,11 @@ bool RpiDataSource::rawSample(RawData *_rawData) const
   return true;
 }
 
+void RpiDataSource::resetStats()
+{
+  __sync_bool_compare_and_swap(&statsReset, 0, 1);
+}
+
 void RpiDataSource::stop()
 {
   if (dataThread == 0)
@@ -3,13 +3,25 @@
 
 #include <pthread.h>
 #include <DataSource.hpp>
+#include <Statistics.hpp>
 #include "Vector.hpp"
 
+/**
+ * Raw sensor data along with running statistics for each sensor channel, x,
+ * y, and z in that order, and for GPS ground speed. The count, mean, standard
+ * deviation, and quantiles cover the time since the data source started or
+ * since the last resetStats(). The min and max cover only the sliding window:
+ * the last second of sensor samples, or the last 60 GPS fixes.
+ */
 struct RawData
 {
   DVector g;
   DVector a;
   DVector m;
+  StatsSummary gStats[3];
+  StatsSummary aStats[3];
+  StatsSummary mStats[3];
+  StatsSummary gsStats;
 };
 
 /**
@@ -34,6 +46,8 @@ public:
 
   bool rawSample(RawData *_rawData) const;
 
+  void resetStats();
+
   void stop();
 
 public:
@@ -41,6 +55,7 @@ public:
 
 private:
   long cancel;
+  long statsReset;
   RawData curRawSample;
   Data curSample;
   pthread_t dataThread;
@@ -1,5 +1,6 @@
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <cstdlib>
 #include <csignal>
 #include <cfloat>
@@ -11,19 +12,32 @@
 #include <syslog.h>
 #include <wiringPi.h>
 #include <config.h>
-#include <AveragingBuffer.hpp>
+#include <RingAverage.hpp>
 #include <FlightDirector.hpp>
 #include <GISDatabase.hpp>
+#include <Terrain.hpp>
+#include <ReachGrid.hpp>
 #include "RpiDataSource.hpp"
 #include "RpiAutopilot.hpp"
 
 using namespace std;
 
+#define NAV_DELAY 1000000 /* 1 Hz */
+#define RUDDER_DELAY 40000 /* 25 Hz */
+
 static const char recoveryDbOpt = 'd';
+static const char memoryIndexOpt = 'm';
+static const char terrainOpt = 't';
+static const char terrainCheckOpt = 'c';
+static const char reachGridOpt = 'r';
 static const char helpOpt = 'h';
-static const char *shortOpts = "d:h";
+static const char *shortOpts = "d:mt:cr:h";
 static const struct option longOpts[] = {
   { "recovery-database", required_argument, nullptr, recoveryDbOpt },
+  { "memory-index", no_argument, nullptr, memoryIndexOpt },
+  { "terrain", required_argument, nullptr, terrainOpt },
+  { "terrain-check", no_argument, nullptr, terrainCheckOpt },
+  { "reach-grid", required_argument, nullptr, reachGridOpt },
   { "help", no_argument, nullptr, helpOpt },
   { nullptr, 0, nullptr, 0 }
 };
@@ -41,6 +55,40 @@ static void signalHandler(int _signum)
   }
 }
 
+static unsigned int elapsedMilliseconds(struct timespec &_last)
+{
+  struct timespec now;
+  u_int64_t diff;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  diff = 1000000000ULL * (now.tv_sec - _last.tv_sec) + now.tv_nsec - _last.tv_nsec;
+  _last = now;
+
+  return (unsigned int)((diff + 500000) / 1000000);
+}
+
+/**
+ * The navigation loop runs on its own thread so that a slow database or
+ * terrain lookup never holds up the rudder loop. It also blinks the light.
+ */
+static void* navThreadProc(void *_ptr)
+{
+  FlightDirector *fd = static_cast<FlightDirector*>(_ptr);
+  struct timespec last;
+  bool l = false;
+
+  clock_gettime(CLOCK_MONOTONIC, &last);
+
+  while (running != 0)
+  {
+    usleep(NAV_DELAY);
+    fd->refreshNavigation(elapsedMilliseconds(last));
+    digitalWrite(1, (l = !l) ? HIGH : LOW);
+  }
+
+  pthread_exit(NULL);
+}
+
 static void logCallback(const char *_fmt, ...)
 {
   int len;
@@ -124,7 +172,8 @@ static int calMag(RpiDataSource *_rds, DVector *_mBias, DVector *_mScale)
 static int calGyro(RpiDataSource *_rds, DVector *_gBias)
 {
   RawData rawSample;
-  AveragingBuffer gx(400), gy(400), gz(400);
+  RingAverage<double, 400, 3> gyro;
+  double g[3];
   int i;
 
   if (!_rds->start())
@@ -137,9 +186,14 @@ static int calGyro(RpiDataSource *_rds, DVector *_gBias)
   {
     _rds->rawSample(&rawSample);
 
-    _gBias->x = gx.pushSample(rawSample.g.x);
-    _gBias->y = gy.pushSample(rawSample.g.y);
-    _gBias->z = gz.pushSample(rawSample.g.z);
+    g[0] = rawSample.g.x;
+    g[1] = rawSample.g.y;
+    g[2] = rawSample.g.z;
+    gyro.pushSample(g, g);
+
+    _gBias->x = g[0];
+    _gBias->y = g[1];
+    _gBias->z = g[2];
 
     usleep(25000);
   }
@@ -168,10 +222,48 @@ static void getRecoveryDbPath(string &_dbPath)
 #endif
 }
 
+static void getTerrainPath(string &_terrainPath)
+{
+#ifdef WIN32
+/* TODO: Get the path based on the ProgramData folder. */
+#else
+  _terrainPath = INSTALL_PREFIX;
+
+  if (!_terrainPath.empty())
+  {
+    if (_terrainPath.back() != '/')
+      _terrainPath.push_back('/');
+  }
+
+  _terrainPath.append("share/otto/terrain");
+#endif
+}
+
+static void getReachGridPath(string &_reachPath)
+{
+#ifdef WIN32
+/* TODO: Get the path based on the ProgramData folder. */
+#else
+  _reachPath = INSTALL_PREFIX;
+
+  if (!_reachPath.empty())
+  {
+    if (_reachPath.back() != '/')
+      _reachPath.push_back('/');
+  }
+
+  _reachPath.append("share/otto/reach.grid");
+#endif
+}
+
 int main(int _argc, char* _argv[])
 {
-  string dbPath;
+  string dbPath, terrainPath, reachPath;
+  unsigned int dbOptions = GISDatabase::optWatch;
+  bool terrainCheck = false;
   getRecoveryDbPath(dbPath);
+  getTerrainPath(terrainPath);
+  getReachGridPath(reachPath);
 
   while (true)
   {
@@ -185,6 +277,18 @@ int main(int _argc, char* _argv[])
     case recoveryDbOpt:
       dbPath = optarg;
       break;
+    case memoryIndexOpt:
+      dbOptions |= GISDatabase::optMemoryIndex;
+      break;
+    case terrainOpt:
+      terrainPath = optarg;
+      break;
+    case terrainCheckOpt:
+      terrainCheck = true;
+      break;
+    case reachGridOpt:
+      reachPath = optarg;
+      break;
     case helpOpt:
       break;
     default:
@@ -194,12 +298,30 @@ int main(int _argc, char* _argv[])
 
   RpiDataSource *rds = new RpiDataSource();
   RpiAutopilot *ap = new RpiAutopilot();
-  GISDatabase *db = new GISDatabase(dbPath.c_str());
-  FlightDirector *fd = new FlightDirector(ap, rds, db, logCallback);
+  GISDatabase *db = new GISDatabase(dbPath.c_str(), dbOptions);
+  Terrain *terrain = new Terrain(terrainPath.c_str());
+
+  /**
+   * The terrain always gives the glide projection its AGL. Checking each glide
+   * path against it as well costs the database's answer memoization, so that
+   * is only done on request.
+   */
+  if (terrainCheck)
+    db->setTerrain(terrain);
+
+  ReachGrid *reach = new ReachGrid();
+
+  // The reachability grid is optional; fall back to database queries.
+  if (!reach->open(reachPath.c_str()))
+  {
+    delete reach;
+    reach = nullptr;
+  }
+
+  FlightDirector *fd = new FlightDirector(ap, rds, db, logCallback, terrain, reach);
   DVector mBias, mScale, gBias;
-  struct timespec start, end;
-  u_int64_t diff;
-  bool l = false;
+  struct timespec last;
+  pthread_t navThread;
 
   signal(SIGINT, signalHandler);
   signal(SIGTERM, signalHandler);
@@ -252,21 +374,25 @@ int main(int _argc, char* _argv[])
 
   fd->enable();
 
-  clock_gettime(CLOCK_MONOTONIC, &start);
-
-  while (running != 0)
+  if (pthread_create(&navThread, NULL, navThreadProc, fd) != 0)
   {
-    usleep(1000000);
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    diff = 1000000000L * (end.tv_sec - start.tv_sec) + end.tv_nsec - start.tv_nsec;
+    logCallback("OTTO: Failed to start navigation thread.");
+    delete fd;
+    return -1;
+  }
 
-    fd->refresh((double)diff / 1000.0);
-    digitalWrite(1, (l = !l) ? HIGH : LOW);
+  // The rudder loop runs here; the navigation loop on navThread.
+  clock_gettime(CLOCK_MONOTONIC, &last);
 
-    start = end;
+  while (running != 0)
+  {
+    usleep(RUDDER_DELAY);
+    fd->refreshRudder(elapsedMilliseconds(last));
   }
 
-  delete fd; // FlightDirector deletes `ap', `rds', and `db'
+  pthread_join(navThread, NULL);
+
+  delete fd; // FlightDirector deletes `ap', `rds', `db', `terrain', and `reach'
   digitalWrite(1, LOW);
   logCallback("OTTO: Shutdown.");
 
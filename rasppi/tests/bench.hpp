@@ -0,0 +1,77 @@
+#ifndef bench_hpp
+#define bench_hpp
+
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <ctime>
+#include <getopt.h>
+
+/**
+ * Scaffolding shared by the benchmarks in this directory: timing, a fast
+ * seeded random number generator, and the options every benchmark takes.
+ */
+
+inline double _elapsedNs(const struct timespec &_start, const struct timespec &_end)
+{
+  return (_end.tv_sec - _start.tv_sec) * 1e9 + (_end.tv_nsec - _start.tv_nsec);
+}
+
+inline double _elapsedUs(const struct timespec &_start, const struct timespec &_end)
+{
+  return _elapsedNs(_start, _end) / 1e3;
+}
+
+/**
+ * xorshift64*. Cheap enough to generate input inside a timed loop, and the
+ * same seed gives the same sequence on every platform, unlike rand().
+ */
+static uint64_t benchRng = 1;
+
+inline void _seedRandom(uint64_t _seed)
+{
+  // splitmix64, so that small seeds still start from a well-mixed state.
+  uint64_t z = _seed + 0x9e3779b97f4a7c15ULL;
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+
+  benchRng = (z != 0 ? z : 1);
+}
+
+inline double _uniform(double _lo, double _hi)
+{
+  // The top 53 bits make a double in [0, 1).
+  benchRng ^= benchRng >> 12;
+  benchRng ^= benchRng << 25;
+  benchRng ^= benchRng >> 27;
+  return _lo + (_hi - _lo) * (((benchRng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/**
+ * Every benchmark takes --seed and --help. BENCH_LONG_OPTS ends a longOpts
+ * table with both and the terminating entry.
+ */
+static const char seedOpt = 'S';
+static const char helpOpt = 'h';
+
+#define BENCH_LONG_OPTS \
+  { "seed", required_argument, nullptr, seedOpt }, \
+  { "help", no_argument, nullptr, helpOpt }, \
+  { nullptr, 0, nullptr, 0 }
+
+/**
+ * Writes the usage message to stderr: `_options', one line per option of the
+ * benchmark's own, followed by the --seed and --help lines with their
+ * descriptions starting at column `_width'.
+ */
+inline void _printUsage(const char *_name, const char *_options, int _width)
+{
+  std::cerr << std::endl << "Usage: " << _name << " [options]" << std::endl << std::endl;
+  std::cerr << _options << std::left;
+  std::cerr << "  " << std::setw(_width - 2) << "-S, --seed <n>" << "Random seed (default: 1)." << std::endl;
+  std::cerr << "  " << std::setw(_width - 2) << "-h, --help" << "Print this message." << std::endl << std::endl;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <Filters.hpp>
+#include "bench.hpp"
+
+/**
+ * Filter benchmark.
+ *
+ * For each filter in Filters.hpp, and RingAverage for comparison, reports the
+ * time per sample, the group delay in samples, and the noise gain (output RMS
+ * over input RMS for white noise), so lag can be traded against smoothing and
+ * CPU. Group delay is measured by feeding a ramp and reading how far behind it
+ * the output settles; for the derivative filter the input is a parabola whose
+ * derivative is the ramp. Results are written to stdout as one JSON object per
+ * line.
+ */
+
+using namespace std;
+
+static const char samplesOpt = 'n';
+static const char *shortOpts = "n:S:h";
+static const struct option longOpts[] = {
+  { "samples", required_argument, nullptr, samplesOpt },
+  BENCH_LONG_OPTS
+};
+
+static const unsigned int settleSamples = 1000;
+static const unsigned int sampleInterval = 1000;  // ms, for TimeAverage
+
+template <typename Filter>
+static void _measure(const char *_name, bool _derivative, uint64_t _count, uint64_t _seed)
+{
+  struct timespec start, end;
+  Filter f;
+  double y = 0.0, in2 = 0.0, out2 = 0.0, x, ns, delay, baseNs;
+  volatile double sink;
+  uint64_t i;
+
+  // Cost of generating the input alone, subtracted from the filter's time.
+  _seedRandom(_seed);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (i = 0; i < _count; ++i)
+    y += _uniform(-1.0, 1.0);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  baseNs = _elapsedNs(start, end) / _count;
+  sink = y;
+
+  _seedRandom(_seed);
+  y = 0.0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (i = 0; i < _count; ++i)
+    y += pushTimed(f, _uniform(-1.0, 1.0), sampleInterval);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  ns = max(_elapsedNs(start, end) / _count - baseNs, 0.0);
+  sink = y;
+  (void)sink;
+
+  // Noise gain, after the filter has settled on the noise above.
+  for (i = 0; i < settleSamples * 100; ++i)
+  {
+    x = _uniform(-1.0, 1.0);
+    y = pushTimed(f, x, sampleInterval);
+    in2 += x * x;
+    out2 += y * y;
+  }
+
+  // Group delay. A ramp of slope 1 lags by exactly the delay once settled.
+  f.reset();
+
+  for (i = 0; i <= settleSamples; ++i)
+  {
+    x = (double)i;
+    y = pushTimed(f, _derivative ? x * x / 2.0 : x, sampleInterval);
+  }
+
+  delay = (double)settleSamples - y;
+
+  printf("{\"filter\":\"%s\",\"ns_per_sample\":%.2f,\"group_delay\":%.3f,\"noise_gain\":%.3f}\n",
+    _name,
+    ns,
+    delay,
+    sqrt(out2 / in2));
+  fflush(stdout);
+}
+
+static void _usage()
+{
+  _printUsage("bench_filters",
+              "  -n, --samples <n>  Samples in each timing run (default: 10000000).\n",
+              21);
+}
+
+int main(int _argc, char* _argv[])
+{
+  uint64_t count = 10000000ULL, seed = 1;
+  int ch;
+
+  while ((ch = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (ch)
+    {
+    case samplesOpt:
+      count = strtoull(optarg, nullptr, 10);
+      break;
+    case seedOpt:
+      seed = strtoull(optarg, nullptr, 10);
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  if (count == 0)
+  {
+    _usage();
+    return -1;
+  }
+
+  _measure<RingAverage<double, 2> >("boxcar_2", false, count, seed);
+  _measure<RingAverage<double, 5> >("boxcar_5", false, count, seed);
+  _measure<Ema<double, 2> >("ema_2", false, count, seed);
+  _measure<Ema<double, 5> >("ema_5", false, count, seed);
+  _measure<LowPass<double, 4> >("lowpass_4", false, count, seed);
+  _measure<LowPass<double, 8> >("lowpass_8", false, count, seed);
+  _measure<SlidingMedian<double, 3> >("median_3", false, count, seed);
+  _measure<SlidingMedian<double, 5> >("median_5", false, count, seed);
+  _measure<FilterChain<SlidingMedian<double, 3>, Ema<double, 2> > >("median_3_ema_2", false, count, seed);
+  _measure<TimeAverage<double, 2000> >("timeavg_2s", false, count, seed);
+  _measure<TimeAverage<double, 5000> >("timeavg_5s", false, count, seed);
+  _measure<SavitzkyGolay<double, 3> >("savgol_deriv_3", true, count, seed);
+  _measure<SavitzkyGolay<double, 5> >("savgol_deriv_5", true, count, seed);
+  _measure<SavitzkyGolay<double, 9> >("savgol_deriv_9", true, count, seed);
+
+  return 0;
+}
@@ -0,0 +1,233 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <Utilities.hpp>
+#include "bench.hpp"
+
+/**
+ * Batched geodesy benchmark.
+ *
+ * Times the batch kernels in Utilities against the single-point functions on
+ * the same random points and reports the largest difference between them.
+ * Exits with an error if a difference is outside the bounds documented in
+ * Utilities.hpp. Results are written to stdout as one JSON object per line.
+ */
+
+using namespace std;
+
+static const char pointsOpt = 'n';
+static const char roundsOpt = 'r';
+static const char *shortOpts = "n:r:S:h";
+static const struct option longOpts[] = {
+  { "points", required_argument, nullptr, pointsOpt },
+  { "rounds", required_argument, nullptr, roundsOpt },
+  BENCH_LONG_OPTS
+};
+
+static const double maxDistance = 10000.0;  // NM
+static const double distanceBound = 1e-9;   // NM
+static const double bearingBound = 1e-9;    // degrees
+static const double positionBound = 1e-10;  // degrees
+
+static void _randomPos(Loc &_pos)
+{
+  // Uniform over the sphere, not over lat/lon.
+  _pos.lat = radToDeg(asin(_uniform(-1.0, 1.0)));
+  _pos.lon = _uniform(-180.0, 180.0);
+}
+
+static double _angleDiff(double _a, double _b)
+{
+  double d = fabs(_a - _b);
+  return min(d, 360.0 - d);
+}
+
+static void _report(const char *_kernel, size_t _points, double _scalarNs, double _batchNs, double _maxError, double _bound)
+{
+  printf("{\"kernel\":\"%s\",\"points\":%zu,\"scalar_ns\":%.2f,\"batch_ns\":%.2f,\"speedup\":%.2f,"
+         "\"max_error\":%.3e,\"bound\":%.0e}\n",
+    _kernel,
+    _points,
+    _scalarNs,
+    _batchNs,
+    _scalarNs / _batchNs,
+    _maxError,
+    _bound);
+  fflush(stdout);
+}
+
+static void _usage()
+{
+  _printUsage("bench_geodesy",
+              "  -n, --points <n>   Points per batch (default: 100000).\n"
+              "  -r, --rounds <n>   Timed rounds per kernel (default: 20).\n",
+              21);
+}
+
+int main(int _argc, char* _argv[])
+{
+  struct timespec start, end;
+  vector<double> lat, lon, hdg, dist, a, b, c, d;
+  size_t count = 100000, rounds = 20, i, r;
+  unsigned int seed = 1;
+  double scalarNs, batchNs, err, errB;
+  Loc origin, dest, p, q;
+  bool ok = true;
+  int ch;
+
+  while ((ch = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (ch)
+    {
+    case pointsOpt:
+      count = (size_t)atol(optarg);
+      break;
+    case roundsOpt:
+      rounds = (size_t)atol(optarg);
+      break;
+    case seedOpt:
+      seed = (unsigned int)atol(optarg);
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  if (count == 0 || rounds == 0)
+  {
+    _usage();
+    return -1;
+  }
+
+  _seedRandom(seed);
+  _randomPos(origin);
+  _randomPos(dest);
+
+  lat.resize(count);
+  lon.resize(count);
+  hdg.resize(count);
+  dist.resize(count);
+  a.resize(count);
+  b.resize(count);
+  c.resize(count);
+  d.resize(count);
+
+  for (i = 0; i < count; ++i)
+  {
+    _randomPos(p);
+    lat[i] = p.lat;
+    lon[i] = p.lon;
+    hdg[i] = _uniform(0.0, 360.0);
+    dist[i] = _uniform(0.0, maxDistance);
+  }
+
+  // Distance and bearing.
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (r = 0; r < rounds; ++r)
+  {
+    for (i = 0; i < count; ++i)
+    {
+      p.lat = lat[i];
+      p.lon = lon[i];
+      getDistanceAndBearing(origin, p, a[i], b[i]);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  scalarNs = _elapsedNs(start, end) / (rounds * count);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (r = 0; r < rounds; ++r)
+    getDistancesAndBearings(origin, lat.data(), lon.data(), count, c.data(), d.data());
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  batchNs = _elapsedNs(start, end) / (rounds * count);
+
+  for (i = 0, err = 0.0, errB = 0.0; i < count; ++i)
+  {
+    err = max(err, fabs(a[i] - c[i]));
+
+    // The bearing to a point a hair from the origin is not meaningful.
+    if (a[i] > 1e-6)
+      errB = max(errB, _angleDiff(b[i], d[i]));
+  }
+
+  _report("distance", count, scalarNs, batchNs, err, distanceBound);
+  _report("bearing", count, scalarNs, batchNs, errB, bearingBound);
+  ok = ok && err <= distanceBound && errB <= bearingBound;
+
+  // Destination.
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (r = 0; r < rounds; ++r)
+  {
+    for (i = 0; i < count; ++i)
+    {
+      getDestination(origin, hdg[i], dist[i], q);
+      a[i] = q.lat;
+      b[i] = q.lon;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  scalarNs = _elapsedNs(start, end) / (rounds * count);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (r = 0; r < rounds; ++r)
+    getDestinations(origin, hdg.data(), dist.data(), count, c.data(), d.data());
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  batchNs = _elapsedNs(start, end) / (rounds * count);
+
+  for (i = 0, err = 0.0; i < count; ++i)
+    err = max(err, max(fabs(a[i] - c[i]), fabs(b[i] - d[i])));
+
+  _report("destination", count, scalarNs, batchNs, err, positionBound);
+  ok = ok && err <= positionBound;
+
+  // Cross-track error.
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (r = 0; r < rounds; ++r)
+  {
+    for (i = 0; i < count; ++i)
+    {
+      p.lat = lat[i];
+      p.lon = lon[i];
+      a[i] = crossTrackError(origin, dest, p);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  scalarNs = _elapsedNs(start, end) / (rounds * count);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (r = 0; r < rounds; ++r)
+    crossTrackErrors(origin, dest, lat.data(), lon.data(), count, c.data());
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  batchNs = _elapsedNs(start, end) / (rounds * count);
+
+  for (i = 0, err = 0.0; i < count; ++i)
+    err = max(err, fabs(a[i] - c[i]));
+
+  _report("cross_track", count, scalarNs, batchNs, err, distanceBound);
+  ok = ok && err <= distanceBound;
+
+  if (!ok)
+  {
+    cerr << "Batch results are outside the documented error bounds." << endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,360 @@
+#include <sys/types.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <GISDatabase.hpp>
+#include <RecoveryWorker.hpp>
+#include <Utilities.hpp>
+#include "bench.hpp"
+
+/**
+ * Recovery database query benchmark.
+ *
+ * For each requested site count, generates a synthetic global recovery CSV,
+ * builds it with rdbtool in every format, and times the same set of random
+ * queries against every lookup backend. Each backend is timed twice: once
+ * for the plain nearest-location query, and once for the region query with
+ * ranked alternates that RecoveryWorker makes. Results are written to stdout
+ * as one JSON object per line; progress goes to stderr.
+ */
+
+using namespace std;
+
+static const char sitesOpt = 's';
+static const char backendsOpt = 'b';
+static const char queriesOpt = 'q';
+static const char rdbtoolOpt = 'r';
+static const char workDirOpt = 'w';
+static const char *shortOpts = "s:b:q:r:w:S:h";
+static const struct option longOpts[] = {
+  { "sites", required_argument, nullptr, sitesOpt },
+  { "backends", required_argument, nullptr, backendsOpt },
+  { "queries", required_argument, nullptr, queriesOpt },
+  { "rdbtool", required_argument, nullptr, rdbtoolOpt },
+  { "work-dir", required_argument, nullptr, workDirOpt },
+  BENCH_LONG_OPTS
+};
+
+static const double minGlideDistance = 5.0;
+static const double maxGlideDistance = 60.0;
+static const double maxGroundElev = 2000.0;
+static const double minHeight = 1000.0;
+static const double maxHeight = 12000.0;
+
+struct Backend
+{
+  const char *name;
+  const char *format;     // rdbtool --format
+  const char *ext;
+  unsigned int options;   // GISDatabase options
+};
+
+/**
+ * Without SpatiaLite, rdbtool cannot build the SpatiaLite format, so the
+ * in-memory index is measured over the R*Tree database instead.
+ */
+static const Backend backends[] = {
+#ifndef NO_SPATIALITE
+  { "spatialite",   "spatialite", ".db",  GISDatabase::optNone },
+  { "memory",       "spatialite", ".db",  GISDatabase::optMemoryIndex },
+#endif
+  { "rtree",        "rtree",      ".rt",  GISDatabase::optNone },
+  { "rtree_memory", "rtree",      ".rt",  GISDatabase::optMemoryIndex },
+  { "flat",         "flat",       ".rdb", GISDatabase::optNone }
+};
+
+struct Query
+{
+  Loc pos;
+  double alt;
+  double hdg;
+  double maxDistance;
+  double elev;          // ground elevation maxDistance glides down to
+};
+
+static void _randomPos(Loc &_pos)
+{
+  // Uniform over the sphere, not over lat/lon.
+  _pos.lat = radToDeg(asin(_uniform(-1.0, 1.0)));
+  _pos.lon = _uniform(-180.0, 180.0);
+}
+
+static void _formatCoord(double _deg, char _pos, char _neg, char *_buf, size_t _len)
+{
+  double a = fabs(_deg), m, s;
+  int d;
+
+  d = (int)a;
+  m = (a - d) * 60.0;
+  s = (m - (int)m) * 60.0;
+
+  snprintf(_buf, _len, "%d %d %.4f%c", d, (int)m, s, _deg < 0.0 ? _neg : _pos);
+}
+
+static bool _writeCsv(const string &_path, size_t _sites)
+{
+  char lat[32], lon[32];
+  FILE *out;
+  Loc pos;
+  size_t i;
+
+  out = fopen(_path.c_str(), "w");
+
+  if (out == nullptr)
+    return false;
+
+  fprintf(out, "Ident,Lat,Lon,Elev\n");
+
+  for (i = 0; i < _sites; ++i)
+  {
+    _randomPos(pos);
+    _formatCoord(pos.lat, 'N', 'S', lat, sizeof(lat));
+    _formatCoord(pos.lon, 'E', 'W', lon, sizeof(lon));
+    fprintf(out, "S%07zu,%s,%s,%.1f\n", i, lat, lon, _uniform(0.0, 8000.0));
+  }
+
+  return (fclose(out) == 0);
+}
+
+static bool _build(const string &_rdbtool, const char *_format, const string &_db, const string &_csv)
+{
+  stringstream cmd;
+
+  remove(_db.c_str());
+  cmd << "'" << _rdbtool << "' --format " << _format << " '" << _db << "' '" << _csv << "' > /dev/null";
+
+  return (system(cmd.str().c_str()) == 0);
+}
+
+static double _percentile(const vector<double> &_sorted, double _p)
+{
+  size_t i = (size_t)(_p * _sorted.size());
+  return _sorted[min(i, _sorted.size() - 1)];
+}
+
+static bool _query(GISDatabase &_db, const Query &_q, bool _region)
+{
+  vector<RecoveryCandidate> cands;
+  RecoveryLocation loc;
+  RecoveryRegion region;
+
+  if (!_region)
+    return _db.getRecoveryLocation(_q.pos, _q.hdg, _q.maxDistance, loc);
+
+  // The query RecoveryWorker makes for FlightDirector.
+  return _db.getRecoveryLocation(_q.pos,
+                                 _q.alt,
+                                 _q.hdg,
+                                 _q.maxDistance,
+                                 _q.elev,
+                                 loc,
+                                 region,
+                                 MAX_RECOVERY_CANDIDATES,
+                                 cands,
+                                 recoveryGlideRatioCost);
+}
+
+static void _time(GISDatabase &_db,
+                  const Backend &_backend,
+                  size_t _sites,
+                  const vector<Query> &_queries,
+                  bool _region,
+                  double _openUs)
+{
+  struct timespec start, end;
+  vector<double> times;
+  double total = 0.0;
+  size_t i, found = 0;
+
+  times.reserve(_queries.size());
+
+  for (i = 0; i < _queries.size(); ++i)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (_query(_db, _queries[i], _region))
+      ++found;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    times.push_back(_elapsedUs(start, end));
+    total += times.back();
+  }
+
+  sort(times.begin(), times.end());
+
+  printf("{\"sites\":%zu,\"backend\":\"%s\",\"path\":\"%s\",\"queries\":%zu,\"found\":%zu,"
+         "\"open_us\":%.1f,\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"max_us\":%.2f}\n",
+    _sites,
+    _backend.name,
+    _region ? "region" : "location",
+    _queries.size(),
+    found,
+    _openUs,
+    total / times.size(),
+    _percentile(times, 0.50),
+    _percentile(times, 0.99),
+    times.back());
+  fflush(stdout);
+}
+
+static void _run(const Backend &_backend, const string &_db, size_t _sites, const vector<Query> &_queries)
+{
+  struct timespec openStart, openEnd;
+
+  clock_gettime(CLOCK_MONOTONIC, &openStart);
+  GISDatabase db(_db.c_str(), _backend.options);
+  clock_gettime(CLOCK_MONOTONIC, &openEnd);
+
+  if (!db.isOpen())
+  {
+    cerr << "Failed to open `" << _db << "' for " << _backend.name << "." << endl;
+    return;
+  }
+
+  _time(db, _backend, _sites, _queries, false, _elapsedUs(openStart, openEnd));
+  _time(db, _backend, _sites, _queries, true, _elapsedUs(openStart, openEnd));
+}
+
+static void _usage()
+{
+  _printUsage("bench_recovery",
+              "  -s, --sites <n,...>    Site counts to generate (default: 50000,500000).\n"
+              "  -b, --backends <b,...> Backends to run (default: all).\n"
+              "  -q, --queries <n>      Queries per backend (default: 2000).\n"
+              "  -r, --rdbtool <path>   rdbtool executable (default: ./rdbtool).\n"
+              "  -w, --work-dir <dir>   Where to put generated databases (default: /tmp).\n",
+              25);
+}
+
+int main(int _argc, char* _argv[])
+{
+  string sites = "50000,500000", selected, rdbtool = "./rdbtool", workDir = "/tmp";
+  vector<size_t> counts;
+  vector<Query> queries;
+  size_t queryCount = 2000, i, j, k;
+  unsigned int seed = 1;
+  const char *p;
+  char *end;
+  int c;
+
+  while ((c = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (c)
+    {
+    case sitesOpt:
+      sites = optarg;
+      break;
+    case backendsOpt:
+      selected = string(",") + optarg + ",";
+      break;
+    case queriesOpt:
+      queryCount = (size_t)atol(optarg);
+      break;
+    case rdbtoolOpt:
+      rdbtool = optarg;
+      break;
+    case workDirOpt:
+      workDir = optarg;
+      break;
+    case seedOpt:
+      seed = (unsigned int)atol(optarg);
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  for (p = sites.c_str(); *p != 0; p = (*end == ',' ? end + 1 : end))
+  {
+    counts.push_back((size_t)strtoul(p, &end, 10));
+
+    if (end == p)
+    {
+      _usage();
+      return -1;
+    }
+  }
+
+  if (queryCount == 0)
+  {
+    _usage();
+    return -1;
+  }
+
+  if (!workDir.empty() && workDir.back() != '/')
+    workDir.push_back('/');
+
+  for (i = 0; i < counts.size(); ++i)
+  {
+    stringstream base;
+    set<size_t> builtDbs;
+    string csv;
+
+    base << workDir << "bench_recovery_" << counts[i];
+    csv = base.str() + ".csv";
+
+    _seedRandom(seed);
+    cerr << "Generating " << counts[i] << " sites..." << endl;
+
+    if (!_writeCsv(csv, counts[i]))
+    {
+      cerr << "Failed to write `" << csv << "'." << endl;
+      return -1;
+    }
+
+    // Every backend and every site count sees the same queries.
+    _seedRandom(seed + 1);
+    queries.resize(queryCount);
+
+    for (j = 0; j < queries.size(); ++j)
+    {
+      _randomPos(queries[j].pos);
+      queries[j].elev = _uniform(0.0, maxGroundElev);
+      queries[j].alt = queries[j].elev + _uniform(minHeight, maxHeight);
+      queries[j].hdg = _uniform(0.0, 360.0);
+      queries[j].maxDistance = _uniform(minGlideDistance, maxGlideDistance);
+    }
+
+    for (j = 0; j < COUNTOF(backends); ++j)
+    {
+      string db = base.str() + backends[j].ext;
+      bool built = false;
+
+      if (!selected.empty() && selected.find(string(",") + backends[j].name + ",") == string::npos)
+        continue;
+
+      // Backends that share a format share one database.
+      for (k = 0; k < j && !built; ++k)
+        built = (strcmp(backends[k].format, backends[j].format) == 0 && builtDbs.count(k) != 0);
+
+      if (!built)
+      {
+        cerr << "Building " << db << "..." << endl;
+
+        if (!_build(rdbtool, backends[j].format, db, csv))
+        {
+          cerr << "Failed to build `" << db << "'." << endl;
+          return -1;
+        }
+      }
+
+      builtDbs.insert(j);
+
+      cerr << "Querying " << backends[j].name << "..." << endl;
+      _run(backends[j], db, counts[i], queries);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <Utilities.hpp>
+#include <ResponseCurves.hpp>
+#include "bench.hpp"
+
+/**
+ * Rudder response curve benchmark.
+ *
+ * Times the table and exact forms of both response curves in ResponseCurves.hpp,
+ * and wrap180() against the fmod() form it replaced, on random inputs. Then
+ * sweeps each curve's whole input domain, including every table knot and the
+ * midpoint between each pair, and reports the largest difference between the
+ * table and the exact curve. Exits with an error if it is outside the bound
+ * documented in ResponseCurves.hpp. Results are written to stdout as one JSON
+ * object per line.
+ */
+
+using namespace std;
+
+static const char pointsOpt = 'n';
+static const char roundsOpt = 'r';
+static const char *shortOpts = "n:r:S:h";
+static const struct option longOpts[] = {
+  { "points", required_argument, nullptr, pointsOpt },
+  { "rounds", required_argument, nullptr, roundsOpt },
+  BENCH_LONG_OPTS
+};
+
+typedef double (*Curve)(double);
+
+static double _fmodWrap(double _deg)
+{
+  return fmod(fmod(_deg, 360.0) + 540.0, 360.0) - 180.0;
+}
+
+template <Curve F>
+static double _time(const vector<double> &_in, size_t _rounds)
+{
+  struct timespec start, end;
+  volatile double sink;
+  double acc = 0.0;
+  size_t i, r;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (r = 0; r < _rounds; ++r)
+  {
+    for (i = 0; i < _in.size(); ++i)
+      acc += F(_in[i]);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  sink = acc;
+  (void)sink;
+
+  return _elapsedNs(start, end) / (_rounds * _in.size());
+}
+
+static double _maxError(Curve _table, Curve _exact, double _max, size_t _points)
+{
+  double err = 0.0, x;
+  size_t i;
+
+  // A dense sweep, then every knot and every midpoint between knots.
+  for (i = 0; i <= _points; ++i)
+  {
+    x = _max * i / _points;
+    err = max(err, fabs(_table(x) - _exact(x)));
+  }
+
+  for (i = 0; i <= 2 * ResponseCurveDetail::intervals; ++i)
+  {
+    x = _max * i / (2 * ResponseCurveDetail::intervals);
+    err = max(err, fabs(_table(x) - _exact(x)));
+  }
+
+  return err;
+}
+
+static void _report(const char *_curve, double _exactNs, double _tableNs, double _maxError, double _bound)
+{
+  printf("{\"curve\":\"%s\",\"exact_ns\":%.2f,\"table_ns\":%.2f,\"speedup\":%.2f,"
+         "\"max_error\":%.3e,\"bound\":%.0e}\n",
+    _curve,
+    _exactNs,
+    _tableNs,
+    _exactNs / _tableNs,
+    _maxError,
+    _bound);
+  fflush(stdout);
+}
+
+static void _usage()
+{
+  _printUsage("bench_response_curves",
+              "  -n, --points <n>   Points per timing batch and error sweep (default: 1000000).\n"
+              "  -r, --rounds <n>   Timed rounds per curve (default: 20).\n",
+              21);
+}
+
+int main(int _argc, char* _argv[])
+{
+  vector<double> hdgErr, rotErr, hdgDiff;
+  size_t count = 1000000, rounds = 20, i;
+  unsigned int seed = 1;
+  double errRt, errAr, wrapErr;
+  bool ok;
+  int ch;
+
+  while ((ch = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (ch)
+    {
+    case pointsOpt:
+      count = (size_t)atol(optarg);
+      break;
+    case roundsOpt:
+      rounds = (size_t)atol(optarg);
+      break;
+    case seedOpt:
+      seed = (unsigned int)atol(optarg);
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  if (count == 0 || rounds == 0)
+  {
+    _usage();
+    return -1;
+  }
+
+  _seedRandom(seed);
+  hdgErr.resize(count);
+  rotErr.resize(count);
+  hdgDiff.resize(count);
+
+  for (i = 0, wrapErr = 0.0; i < count; ++i)
+  {
+    hdgErr[i] = _uniform(0.0, rateOfTurnCurveMax);
+    rotErr[i] = _uniform(0.0, rudderCurveMax);
+    hdgDiff[i] = _uniform(0.0, 360.0) - _uniform(0.0, 360.0);
+
+    // wrap180() may differ from the fmod() form only by rounding.
+    wrapErr = max(wrapErr, fabs(wrap180(hdgDiff[i]) - _fmodWrap(hdgDiff[i])));
+  }
+
+  errRt = _maxError(tableRateOfTurnCurve, exactRateOfTurnCurve, rateOfTurnCurveMax, count);
+  errAr = _maxError(tableRudderCurve, exactRudderCurve, rudderCurveMax, count);
+
+  _report("rate_of_turn",
+    _time<exactRateOfTurnCurve>(hdgErr, rounds),
+    _time<tableRateOfTurnCurve>(hdgErr, rounds),
+    errRt,
+    rateOfTurnCurveBound);
+  _report("rudder",
+    _time<exactRudderCurve>(rotErr, rounds),
+    _time<tableRudderCurve>(rotErr, rounds),
+    errAr,
+    rudderCurveBound);
+  _report("heading_wrap",
+    _time<_fmodWrap>(hdgDiff, rounds),
+    _time<wrap180>(hdgDiff, rounds),
+    wrapErr,
+    1e-12);
+
+  ok = errRt <= rateOfTurnCurveBound && errAr <= rudderCurveBound && wrapErr <= 1e-12;
+
+  if (!ok)
+  {
+    cerr << "Table results are outside the documented error bounds." << endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,253 @@
+#include <iostream>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <RingAverage.hpp>
+#include "bench.hpp"
+
+/**
+ * RingAverage soak benchmark.
+ *
+ * Pushes a long stream of noisy samples through RingAverage and through a
+ * plain add-and-subtract running sum, the way AveragingBuffer kept its total,
+ * in both double and float. Every so often the averages are compared with the
+ * exact average of the window. The largest error seen so far is written at
+ * every power of ten samples, and the time per push at the end, as one JSON
+ * object per line.
+ *
+ * RingAverage re-bases its sum every N pushes, so its error comes from the
+ * rounding of at most 2N additions. Those roundings are independent and add up
+ * like a random walk, so the error of the average stays within about sqrt(2N)
+ * ulps of the largest sample. Exits with an error if it is ever outside that
+ * bound. The running sum has no bound; over the default soak it drifts well
+ * outside this one, which is reported alongside.
+ */
+
+using namespace std;
+
+static const char samplesOpt = 'n';
+static const char timedOpt = 't';
+static const char *shortOpts = "n:t:S:h";
+static const struct option longOpts[] = {
+  { "samples", required_argument, nullptr, samplesOpt },
+  { "timed", required_argument, nullptr, timedOpt },
+  BENCH_LONG_OPTS
+};
+
+static const unsigned int window = 800;        // 1 second at 800 Hz
+static const double bias = 100.0;
+static const double noise = 400.0;
+static const uint64_t checkInterval = 1 << 16;
+
+/**
+ * The old AveragingBuffer update, for comparison.
+ */
+template <typename T, unsigned int N>
+class RunningSum
+{
+public:
+  RunningSum()
+  : i(0),
+    samples(0),
+    total(0)
+  {
+    for (unsigned int j = 0; j < N; ++j)
+      buffer[j] = 0;
+  }
+
+public:
+  T pushSample(T _sample)
+  {
+    total -= buffer[i];
+    total += _sample;
+    buffer[i] = _sample;
+    i = (i + 1 == N ? 0 : i + 1);
+    samples = (samples < N ? samples + 1 : N);
+    return total / samples;
+  }
+
+private:
+  T buffer[N];
+  unsigned int i, samples;
+  T total;
+};
+
+static double _nextSample()
+{
+  return bias + _uniform(-noise, noise);
+}
+
+template <typename T>
+static double _exactAverage(const T *_history)
+{
+  long double s = 0.0L, c = 0.0L, t;
+  unsigned int i;
+
+  // Neumaier summation in long double; exact for our purposes.
+  for (i = 0; i < window; ++i)
+  {
+    t = s + _history[i];
+
+    if (fabsl(s) >= fabsl((long double)_history[i]))
+      c += (s - t) + _history[i];
+    else
+      c += (_history[i] - t) + s;
+
+    s = t;
+  }
+
+  return (double)((s + c) / window);
+}
+
+template <typename T>
+static double _bound()
+{
+  return sqrt(2.0 * window) * numeric_limits<T>::epsilon() * (fabs(bias) + noise);
+}
+
+template <typename Avg, typename T>
+static double _timePushes(uint64_t _count)
+{
+  struct timespec start, end;
+  Avg *avg = new Avg;
+  volatile T sink;
+  T acc = 0;
+  uint64_t i;
+
+  _seedRandom(0);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (i = 0; i < _count; ++i)
+    acc += avg->pushSample((T)_nextSample());
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  sink = acc;
+  (void)sink;
+  delete avg;
+
+  return _elapsedNs(start, end) / _count;
+}
+
+static void _usage()
+{
+  _printUsage("bench_ring_average",
+              "  -n, --samples <n>  Samples in the soak (default: 1000000000).\n"
+              "  -t, --timed <n>    Samples in each timing run (default: 100000000).\n",
+              21);
+}
+
+int main(int _argc, char* _argv[])
+{
+  // Large enough that they are better off the stack.
+  RingAverage<double, window> *ringD = new RingAverage<double, window>;
+  RingAverage<float, window> *ringF = new RingAverage<float, window>;
+  RunningSum<double, window> *sumD = new RunningSum<double, window>;
+  RunningSum<float, window> *sumF = new RunningSum<float, window>;
+  double histD[window], ref, x, aRingD = 0, aSumD = 0;
+  float histF[window], aRingF = 0, aSumF = 0;
+  double errRingD = 0, errSumD = 0, errRingF = 0, errSumF = 0;
+  uint64_t count = 1000000000ULL, timed = 100000000ULL, seed = 1, i, nextReport = 10;
+  unsigned int h = 0;
+  bool ok;
+  int ch;
+
+  while ((ch = getopt_long(_argc, _argv, shortOpts, longOpts, nullptr)) != -1)
+  {
+    switch (ch)
+    {
+    case samplesOpt:
+      count = strtoull(optarg, nullptr, 10);
+      break;
+    case timedOpt:
+      timed = strtoull(optarg, nullptr, 10);
+      break;
+    case seedOpt:
+      seed = strtoull(optarg, nullptr, 10);
+      break;
+    case helpOpt:
+    default:
+      _usage();
+      return -1;
+    }
+  }
+
+  if (count < window || timed == 0)
+  {
+    _usage();
+    return -1;
+  }
+
+  _seedRandom(seed);
+
+  for (i = 1; i <= count; ++i)
+  {
+    x = _nextSample();
+    histD[h] = x;
+    histF[h] = (float)x;
+    h = (h + 1 == window ? 0 : h + 1);
+
+    aRingD = ringD->pushSample(x);
+    aSumD = sumD->pushSample(x);
+    aRingF = ringF->pushSample((float)x);
+    aSumF = sumF->pushSample((float)x);
+
+    if (i >= window && (i % checkInterval == 0 || i == nextReport || i == count))
+    {
+      ref = _exactAverage(histD);
+      errRingD = max(errRingD, fabs(aRingD - ref));
+      errSumD = max(errSumD, fabs(aSumD - ref));
+
+      ref = _exactAverage(histF);
+      errRingF = max(errRingF, fabs(aRingF - ref));
+      errSumF = max(errSumF, fabs(aSumF - ref));
+    }
+
+    if (i == nextReport || i == count)
+    {
+      printf("{\"samples\":%llu,\"ring_double_error\":%.3e,\"sum_double_error\":%.3e,"
+             "\"ring_float_error\":%.3e,\"sum_float_error\":%.3e}\n",
+        (unsigned long long)i,
+        errRingD,
+        errSumD,
+        errRingF,
+        errSumF);
+      fflush(stdout);
+
+      nextReport *= 10;
+    }
+  }
+
+  printf("{\"window\":%u,\"ring_double_ns\":%.2f,\"sum_double_ns\":%.2f,"
+         "\"ring_float_ns\":%.2f,\"sum_float_ns\":%.2f,"
+         "\"double_bound\":%.3e,\"float_bound\":%.3e,"
+         "\"sum_double_outside\":%s,\"sum_float_outside\":%s}\n",
+    window,
+    _timePushes<RingAverage<double, window>, double>(timed),
+    _timePushes<RunningSum<double, window>, double>(timed),
+    _timePushes<RingAverage<float, window>, float>(timed),
+    _timePushes<RunningSum<float, window>, float>(timed),
+    _bound<double>(),
+    _bound<float>(),
+    errSumD > _bound<double>() ? "true" : "false",
+    errSumF > _bound<float>() ? "true" : "false");
+
+  ok = errRingD <= _bound<double>() && errRingF <= _bound<float>();
+
+  delete ringD;
+  delete ringF;
+  delete sumD;
+  delete sumF;
+
+  if (!ok)
+  {
+    cerr << "RingAverage error is outside its bound." << endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -6,7 +6,6 @@
 #include <cmath>
 #include <unistd.h>
 #include <wiringPi.h>
-#include <AveragingBuffer.hpp>
 #include "Arduino.hpp"
 #include "RpiDataSource.hpp"
 #include "HD44780.hpp"
@@ -6,7 +6,7 @@
 #include <cmath>
 #include <unistd.h>
 #include <wiringPi.h>
-#include <AveragingBuffer.hpp>
+#include <RingAverage.hpp>
 #include "LSM6DS33.hpp"
 #include "LIS3MDL.hpp"
 #include "HD44780.hpp"
@@ -58,7 +58,8 @@ int main(int _argc, char* _argv[])
   char buf[17];
 #endif
   DVector m, a, g, gb;
-  AveragingBuffer gbx(BIAS_SAMPLES), gby(BIAS_SAMPLES), gbz(BIAS_SAMPLES);
+  RingAverage<double, BIAS_SAMPLES, 3> gbias;
+  double gs[3];
   int64_t t, t1, r;
   timespec spec;
   float q[4], e[3];
@@ -125,9 +126,14 @@ int main(int _argc, char* _argv[])
     imuGyroAccel.readAccel(a);
 
 #ifndef NO_BIAS_REMOVAL
-    g.x -= (gb.x = gbx.pushSample(g.x));
-    g.y -= (gb.y = gby.pushSample(g.y));
-    g.z -= (gb.z = gbz.pushSample(g.z));
+    gs[0] = g.x;
+    gs[1] = g.y;
+    gs[2] = g.z;
+    gbias.pushSample(gs, gs);
+
+    g.x -= (gb.x = gs[0]);
+    g.y -= (gb.y = gs[1]);
+    g.z -= (gb.z = gs[2]);
 #endif
 
     g.x = DEG2RADF(g.x);
@@ -44,6 +44,8 @@ bool XPlaneDataSource::sample(Data *_data) const
     _data->pos.lon = XPLMGetDatad(lonRef);
   }
 
+  toNVector(_data->pos, _data->nv);
+
   if (altRef != nullptr)
   {
     _data->avail |= DATA_ALT;
@@ -11,21 +11,31 @@
 #include <XPLM/XPLMProcessing.h>
 #include <XPLM/XPLMUtilities.h>
 #include "FlightDirector.hpp"
+#include "Terrain.hpp"
+#include "ReachGrid.hpp"
 #include "Utilities.hpp"
 #include "XPlaneAutopilot.hpp"
 #include "XPlaneDataSource.hpp"
 
-#define UPDATE_INTERVAL 1.0f
+#define NAV_INTERVAL 1.0f
+#define RUDDER_INTERVAL 0.04f /* 25 Hz */
 
 using namespace std;
 
 static FlightDirector *fd;
 
-static float flightLoopCallback(float _elapsedSinceLastCall, float _elapsedSinceLastFlightLoop, int _counter, void *_arg)
+static float navLoopCallback(float _elapsedSinceLastCall, float _elapsedSinceLastFlightLoop, int _counter, void *_arg)
 {
-  fd->refresh((unsigned int)(max(_elapsedSinceLastCall, 0.0f) * 1000 + 0.5));
+  fd->refreshNavigation((unsigned int)(max(_elapsedSinceLastCall, 0.0f) * 1000 + 0.5));
   
-  return UPDATE_INTERVAL;
+  return NAV_INTERVAL;
+}
+
+static float rudderLoopCallback(float _elapsedSinceLastCall, float _elapsedSinceLastFlightLoop, int _counter, void *_arg)
+{
+  fd->refreshRudder((unsigned int)(max(_elapsedSinceLastCall, 0.0f) * 1000 + 0.5));
+  
+  return RUDDER_INTERVAL;
 }
 
 static void logCallback(const char *_fmt, ...)
@@ -52,8 +62,10 @@ PLUGIN_API int XPluginStart(char *_outName, char *_outSig, char *_outDesc)
 #ifdef APL
   Dl_info info;
 #endif
-  char path[512], *base;
+  char path[512], terrainPath[512], reachPath[512], *base;
   GISDatabase *db;
+  Terrain *terrain;
+  ReachGrid *reach;
   
   strncpy(_outName, "OTTO", 256);
   strncpy(_outSig, "org.or034.otto", 256);
@@ -74,21 +86,41 @@ PLUGIN_API int XPluginStart(char *_outName, char *_outSig, char *_outDesc)
     strncpy(path, info.dli_fname, 512);
     base = dirname(path);
     strncpy(path, base, 512);
+    strncpy(terrainPath, base, 512);
+    strncpy(reachPath, base, 512);
     strcat(path, "/recovery.db");
+    strcat(terrainPath, "/terrain");
+    strcat(reachPath, "/reach.grid");
   }
 
 #endif
   
   logCallback("OTTO: attempting to open recovery database: %s\n", path);
   
-  db = new GISDatabase(path);
+  db = new GISDatabase(path, GISDatabase::optWatch);
   
   if (!db->isOpen())
     logCallback("OTTO: failed to open recovery database.\n");
+
+  /**
+   * The terrain gives the glide projection its AGL. It is not handed to the
+   * database: checking every glide path against it would cost the database's
+   * answer memoization. Call db->setTerrain(terrain) to check them anyway.
+   */
+  terrain = new Terrain(terrainPath);
+
+  reach = new ReachGrid();
+
+  if (!reach->open(reachPath))
+  {
+    delete reach;
+    reach = nullptr;
+  }
   
-  fd = new FlightDirector(new XPlaneAutopilot(), new XPlaneDataSource(), db, logCallback);
+  fd = new FlightDirector(new XPlaneAutopilot(), new XPlaneDataSource(), db, logCallback, terrain, reach);
 
-  XPLMRegisterFlightLoopCallback(flightLoopCallback, UPDATE_INTERVAL, fd);
+  XPLMRegisterFlightLoopCallback(navLoopCallback, NAV_INTERVAL, fd);
+  XPLMRegisterFlightLoopCallback(rudderLoopCallback, RUDDER_INTERVAL, fd);
   
   return 1;
 }
@@ -97,21 +129,24 @@ PLUGIN_API int XPluginEnable()
 {
   fd->enable();
   
-  XPLMSetFlightLoopCallbackInterval(flightLoopCallback, UPDATE_INTERVAL, 0, fd);
+  XPLMSetFlightLoopCallbackInterval(navLoopCallback, NAV_INTERVAL, 0, fd);
+  XPLMSetFlightLoopCallbackInterval(rudderLoopCallback, RUDDER_INTERVAL, 0, fd);
 
   return 1;
 }
 
 PLUGIN_API void XPluginDisable()
 {
-  XPLMSetFlightLoopCallbackInterval(flightLoopCallback, 0.0f, 0, fd);
+  XPLMSetFlightLoopCallbackInterval(navLoopCallback, 0.0f, 0, fd);
+  XPLMSetFlightLoopCallbackInterval(rudderLoopCallback, 0.0f, 0, fd);
   
   fd->disable();
 }
 
 PLUGIN_API void XPluginStop()
 {
-  XPLMUnregisterFlightLoopCallback(flightLoopCallback, fd);
+  XPLMUnregisterFlightLoopCallback(navLoopCallback, fd);
+  XPLMUnregisterFlightLoopCallback(rudderLoopCallback, fd);
   
   delete fd;
 }